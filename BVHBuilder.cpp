@@ -0,0 +1,172 @@
+#include "BVHBuilder.h"
+
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <thread>
+
+// Up to this depth, nodes are split using the surface area heuristic,
+// deeper nodes are split at the median.
+// This bounds the depth of the tree by 64 for up to 2^32 primitives, so
+// that the traversals can use a fixed size stack (bvhMaxStackSize).
+static const uint32_t sahSplitDepth = 32;
+
+// Number of bins for evaluating the surface area heuristic
+static const int nBins = 16;
+
+// Subtrees with at least this many primitives are built in parallel
+static const uint32_t minParallelBuildPrims = 1 << 14;
+
+// Returns the index of the first primitive of the right child, after
+// partitioning [start, end) along the best split of the binned surface
+// area heuristic. Returns start if no useful split was found.
+static uint32_t splitSAH(std::vector<BVHBuildPrim>& prims, uint32_t start, uint32_t end,
+                         const BBox& bc, uint32_t splitDim)
+{
+    const float cmin = bc.min[splitDim];
+    const float extent = bc.max[splitDim] - cmin;
+    if(!(extent > 0)) {
+        return start;
+    }
+    const float k = nBins * (1 - 1e-4f) / extent;
+    auto binOf = [&](const BVHBuildPrim& p) {
+        return std::min(nBins-1, static_cast<int>(k * (p.centroid[splitDim] - cmin)));
+    };
+
+    BBox bins[nBins];
+    uint32_t counts[nBins] = {0};
+    for(uint32_t i = start; i < end; ++i) {
+        const int b = binOf(prims[i]);
+        if(counts[b] == 0) {
+            bins[b] = prims[i].bbox;
+        }
+        else {
+            bins[b].expandToInclude(prims[i].bbox);
+        }
+        ++counts[b];
+    }
+
+    // area and count of everything right of split i (i.e. bins i+1 ...)
+    float rightArea[nBins];
+    uint32_t rightCount[nBins];
+    BBox acc;
+    uint32_t n = 0;
+    for(int i = nBins-1; i > 0; --i) {
+        if(counts[i] > 0) {
+            if(n == 0) { acc = bins[i]; } else { acc.expandToInclude(bins[i]); }
+            n += counts[i];
+        }
+        rightArea[i-1] = n > 0 ? acc.surfaceArea() : 0;
+        rightCount[i-1] = n;
+    }
+
+    int best = -1;
+    float bestCost = std::numeric_limits<float>::max();
+    n = 0;
+    for(int i = 0; i < nBins-1; ++i) {
+        if(counts[i] > 0) {
+            if(n == 0) { acc = bins[i]; } else { acc.expandToInclude(bins[i]); }
+            n += counts[i];
+        }
+        if(n == 0 || rightCount[i] == 0) {
+            continue;
+        }
+        const float cost = n * acc.surfaceArea() + rightCount[i] * rightArea[i];
+        if(cost < bestCost) {
+            bestCost = cost;
+            best = i;
+        }
+    }
+    if(best < 0) {
+        return start;
+    }
+
+    auto it = std::partition(prims.begin()+start, prims.begin()+end,
+        [&](const BVHBuildPrim& p) { return binOf(p) <= best; });
+    return it - prims.begin();
+}
+
+static void build(std::vector<BVHBuildPrim>& prims, uint32_t start, uint32_t end, uint32_t depth,
+                  uint32_t leafSize, int nThreads, std::vector<MeshBVHNode>& nodes)
+{
+    const uint32_t ni = nodes.size();
+    nodes.push_back(MeshBVHNode());
+
+    BBox bb(prims[start].bbox);
+    BBox bc(prims[start].centroid);
+    for(uint32_t p = start+1; p < end; ++p) {
+        bb.expandToInclude(prims[p].bbox);
+        bc.expandToInclude(prims[p].centroid);
+    }
+
+    MeshBVHNode& node = nodes[ni];
+    node.bbox = bb;
+    node.start = start;
+    node.nPrims = end - start;
+    node.rightOffset = 0;
+    if(end - start <= leafSize) {
+        return;
+    }
+
+    const uint32_t splitDim = bc.maxDimension();
+    uint32_t mid = start;
+    if(depth < sahSplitDepth) {
+        mid = splitSAH(prims, start, end, bc, splitDim);
+    }
+    if(mid == start || mid == end) {
+        mid = start + (end-start)/2;
+        std::nth_element(prims.begin()+start, prims.begin()+mid, prims.begin()+end,
+            [splitDim](const BVHBuildPrim& a, const BVHBuildPrim& b) {
+                return a.centroid[splitDim] < b.centroid[splitDim];
+            });
+    }
+
+    if(nThreads > 1 && end - start >= minParallelBuildPrims) {
+        // Both children work on disjoint ranges of prims. The left subtree
+        // is built on a new thread into its own node array, which is then
+        // spliced in; rightOffsets are relative, so no fix-up is needed.
+        // An exception of either side (e.g. bad_alloc) is rethrown here
+        // once the thread has finished.
+        std::vector<MeshBVHNode> left;
+        std::exception_ptr leftError;
+        std::thread t([&]() {
+            try {
+                build(prims, start, mid, depth+1, leafSize, nThreads/2, left);
+            }
+            catch(...) {
+                leftError = std::current_exception();
+            }
+        });
+        std::vector<MeshBVHNode> right;
+        try {
+            build(prims, mid, end, depth+1, leafSize, nThreads - nThreads/2, right);
+        }
+        catch(...) {
+            t.join();
+            throw;
+        }
+        t.join();
+        if(leftError) {
+            std::rethrow_exception(leftError);
+        }
+        nodes[ni].rightOffset = 1 + left.size();
+        nodes.insert(nodes.end(), left.begin(), left.end());
+        nodes.insert(nodes.end(), right.begin(), right.end());
+    }
+    else {
+        build(prims, start, mid, depth+1, leafSize, 1, nodes);
+        nodes[ni].rightOffset = nodes.size() - ni;
+        build(prims, mid, end, depth+1, leafSize, 1, nodes);
+    }
+}
+
+std::vector<MeshBVHNode> buildBVHNodes(std::vector<BVHBuildPrim>& prims, uint32_t leafSize, int nThreads)
+{
+    std::vector<MeshBVHNode> nodes;
+    if(prims.empty()) {
+        return nodes;
+    }
+    nodes.reserve(2*prims.size()/leafSize + 1);
+    build(prims, 0, prims.size(), 0, leafSize, nThreads, nodes);
+    return nodes;
+}
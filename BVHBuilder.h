@@ -0,0 +1,42 @@
+#ifndef BVHBUILDER_H
+#define BVHBUILDER_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "fastbvh/BBox.h"
+#include "fastbvh/Vector3.h"
+
+/**
+ * Node of a flattened BVH, same layout as Fast-BVH's BVHFlatNode:
+ * the left child of node i is i+1, the right child is i+rightOffset,
+ * and rightOffset == 0 marks a leaf covering triangles
+ * [start, start+nPrims).
+ */
+struct MeshBVHNode {
+    BBox bbox;
+    uint32_t start, nPrims, rightOffset;
+};
+
+/**
+ * Bounding box and centroid of a primitive, cached during the build.
+ * index identifies the primitive.
+ */
+struct BVHBuildPrim {
+    BBox bbox;
+    Vector3 centroid;
+    uint32_t index;
+};
+
+/**
+ * Builds a flattened BVH over prims, which are reordered such that
+ * leaves cover consecutive ranges of them.
+ * Nodes with more than leafSize primitives are split with the binned
+ * surface area heuristic; large subtrees are built on up to nThreads
+ * threads. The tree is at most bvhMaxStackSize-2 levels deep.
+ */
+std::vector<MeshBVHNode> buildBVHNodes(std::vector<BVHBuildPrim>& prims, uint32_t leafSize, int nThreads);
+
+static const uint32_t bvhMaxStackSize = 66;
+
+#endif /* BVHBUILDER_H */
@@ -0,0 +1,204 @@
+#include "ChunkedVolumeWriter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "Parallel.h"
+
+ChunkedVolumeWriter::Codec ChunkedVolumeWriter::parseCodec(const std::string& name)
+{
+    if(name == "none") {
+        return None;
+    }
+    if(name == "gzip") {
+        return Gzip;
+    }
+    if(name == "shuffle-gzip") {
+        return ShuffleGzip;
+    }
+    throw std::runtime_error("unknown codec '" + name + "' (expected none, gzip or shuffle-gzip)");
+}
+
+vigra::Shape3 ChunkedVolumeWriter::clipChunkShape(const vigra::Shape3& shape, const vigra::Shape3& chunkShape)
+{
+    vigra::Shape3 clipped;
+    for(int i=0; i<3; ++i) {
+        clipped[i] = std::max<vigra::MultiArrayIndex>(1, std::min(chunkShape[i], shape[i]));
+    }
+    return clipped;
+}
+
+ChunkedVolumeWriter::ChunkedVolumeWriter(const vigra::Shape3& shape, const vigra::Shape3& chunkShape,
+                                         LabelType labelType, Codec codec, int level, int nThreads)
+    : shape_(shape), chunkShape_(clipChunkShape(shape, chunkShape)), labelType_(labelType),
+      codec_(codec), level_(level), nThreads_(nThreads), updating_(false),
+      rawBytes_(0), storedBytes_(0), nChunksStored_(0), nChunksSkipped_(0), seconds_(0)
+{
+}
+
+// Copies the chunk at begin (relative to block) into buffer, padded with
+// zeros to the full chunk shape, and encodes it into out.
+// Returns false (and leaves out empty) if the chunk is all background,
+// unless keepEmpty is set.
+template<class T>
+bool ChunkedVolumeWriter::encodeChunk(const vigra::MultiArray<3, T>& block, const vigra::Shape3& begin,
+                                      std::vector<T>& buffer, std::vector<char>& out, bool keepEmpty) const
+{
+    out.clear();
+    const size_t n = chunkShape_[0]*chunkShape_[1]*chunkShape_[2];
+    buffer.assign(n, 0);
+    const vigra::MultiArrayIndex n0 = std::min(chunkShape_[0], block.shape(0) - begin[0]);
+    const vigra::MultiArrayIndex n1 = std::min(chunkShape_[1], block.shape(1) - begin[1]);
+    const vigra::MultiArrayIndex n2 = std::min(chunkShape_[2], block.shape(2) - begin[2]);
+    bool empty = true;
+    for(vigra::MultiArrayIndex k=0; k<n2; ++k) {
+        for(vigra::MultiArrayIndex j=0; j<n1; ++j) {
+            const T* row = &block(begin[0], begin[1]+j, begin[2]+k);
+            if(empty) {
+                empty = std::find_if(row, row + n0, [](T l) { return l != 0; }) == row + n0;
+            }
+            std::copy(row, row + n0, buffer.begin() + (k*chunkShape_[1] + j)*chunkShape_[0]);
+        }
+    }
+    if(empty && !keepEmpty) {
+        return false;
+    }
+
+    const char* raw = reinterpret_cast<const char*>(buffer.data());
+    const size_t rawSize = n*sizeof(T);
+    if(codec_ == None) {
+        out.assign(raw, raw + rawSize);
+        return true;
+    }
+
+    std::vector<char> shuffled;
+    if(codec_ == ShuffleGzip) {
+        // byte b of all labels, for b from the lowest to the highest
+        shuffled.resize(rawSize);
+        for(size_t i=0; i<n; ++i) {
+            for(size_t b=0; b<sizeof(T); ++b) {
+                shuffled[b*n+i] = raw[sizeof(T)*i+b];
+            }
+        }
+        raw = shuffled.data();
+    }
+
+    uLongf size = compressBound(rawSize);
+    out.resize(size);
+    if(compress2(reinterpret_cast<Bytef*>(out.data()), &size,
+                 reinterpret_cast<const Bytef*>(raw), rawSize, level_) != Z_OK)
+    {
+        throw std::runtime_error("ChunkedVolumeWriter: compression failed");
+    }
+    out.resize(size);
+    return true;
+}
+
+template<class T>
+void ChunkedVolumeWriter::write(const vigra::MultiArray<3, T>& block, const vigra::Shape3& offset)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+
+    if(LabelTypeOf<T>::value != labelType_) {
+        throw std::runtime_error(std::string("ChunkedVolumeWriter: block is not of the label type ")
+                                 + labelTypeName(labelType_));
+    }
+
+    vigra::Shape3 nChunks;
+    for(int i=0; i<3; ++i) {
+        if(offset[i] % chunkShape_[i] != 0 ||
+           (block.shape(i) % chunkShape_[i] != 0 && offset[i] + block.shape(i) != shape_[i]))
+        {
+            throw std::runtime_error("ChunkedVolumeWriter: block is not aligned to chunks");
+        }
+        nChunks[i] = (block.shape(i) + chunkShape_[i] - 1) / chunkShape_[i];
+    }
+    const size_t n = nChunks[0]*nChunks[1]*nChunks[2];
+    auto chunkBegin = [&](size_t c) {
+        return vigra::Shape3((c % nChunks[0]) * chunkShape_[0],
+                             (c / nChunks[0] % nChunks[1]) * chunkShape_[1],
+                             (c / nChunks[0] / nChunks[1]) * chunkShape_[2]);
+    };
+    auto chunkIndex = [&](size_t c) {
+        const vigra::Shape3 b = chunkBegin(c);
+        return vigra::Shape3((offset[0] + b[0]) / chunkShape_[0],
+                             (offset[1] + b[1]) / chunkShape_[1],
+                             (offset[2] + b[2]) / chunkShape_[2]);
+    };
+
+    // When updating, empty chunks have to be erased, or replaced by this
+    // (shared) encoded chunk of zeros where the backend cannot erase them.
+    std::vector<char> zeros;
+    if(updating_) {
+        std::vector<T> buffer;
+        const vigra::MultiArray<3, T> empty(chunkShape_);
+        encodeChunk(empty, vigra::Shape3(0, 0, 0), buffer, zeros, true);
+    }
+    // Erases the (empty) chunk c, returns the bytes stored instead.
+    std::atomic<uint64_t> nZeroChunks(0);
+    auto erase = [&](size_t c) -> uint64_t {
+        if(eraseChunk(chunkIndex(c))) {
+            return 0;
+        }
+        storeChunk(chunkIndex(c), zeros);
+        ++nZeroChunks;
+        return zeros.size();
+    };
+
+    // Encode the chunks of the block in parallel. Backends which can,
+    // store each chunk right away. The others (e.g. HDF5 must only be
+    // called from one thread at a time) get them in order, after each
+    // batch of a few chunks per thread, so that only one batch is held
+    // encoded rather than the whole block.
+    const bool concurrent = storesConcurrently();
+    const int nThreads = std::max(1, nThreads_);
+    const size_t batchSize = concurrent ? n : 4*size_t(nThreads);
+    std::vector<std::vector<char> > encoded(concurrent ? nThreads : std::min(batchSize, n));
+    std::vector<std::vector<T> > buffers(nThreads);
+    std::vector<char> stored(n, 0);
+    std::atomic<uint64_t> storedBytes(0);
+    for(size_t batch=0; batch<n; batch+=batchSize) {
+        const size_t batchEnd = std::min(n, batch + batchSize);
+        parallelFor(batchEnd - batch, nThreads_, [&](size_t i, int threadIndex) {
+            const size_t c = batch + i;
+            std::vector<char>& out = encoded[concurrent ? threadIndex : i];
+            stored[c] = encodeChunk(block, chunkBegin(c), buffers[threadIndex], out);
+            if(concurrent && stored[c]) {
+                storeChunk(chunkIndex(c), out);
+                storedBytes += out.size();
+            }
+            else if(concurrent && updating_) {
+                storedBytes += erase(c);
+            }
+        });
+
+        for(size_t c=batch; c<batchEnd; ++c) {
+            if(!stored[c]) {
+                ++nChunksSkipped_;
+                if(!concurrent && updating_) {
+                    storedBytes += erase(c);
+                }
+                continue;
+            }
+            ++nChunksStored_;
+            if(!concurrent) {
+                storeChunk(chunkIndex(c), encoded[c - batch]);
+                storedBytes += encoded[c - batch].size();
+            }
+        }
+    }
+    nChunksSkipped_ -= nZeroChunks;
+    nChunksStored_ += nZeroChunks;
+    storedBytes_ += storedBytes;
+    rawBytes_ += block.size()*sizeof(T);
+
+    seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template void ChunkedVolumeWriter::write(const vigra::MultiArray<3, uint8_t>&, const vigra::Shape3&);
+template void ChunkedVolumeWriter::write(const vigra::MultiArray<3, uint16_t>&, const vigra::Shape3&);
+template void ChunkedVolumeWriter::write(const vigra::MultiArray<3, uint32_t>&, const vigra::Shape3&);
@@ -0,0 +1,123 @@
+#ifndef CHUNKEDVOLUMEWRITER_H
+#define CHUNKEDVOLUMEWRITER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <vigra/multi_array.hxx>
+
+#include "LabelType.h"
+
+/**
+ * Base class of the writers for chunked label volumes of any of the
+ * label types (see LabelType.h).
+ *
+ * write() cuts a block of the volume into chunks, encodes them in
+ * parallel and hands them to the backend (see HDF5ChunkWriter,
+ * ZarrWriter). Chunks which only contain background (0) are not stored
+ * at all; all supported formats read missing chunks as zeros.
+ *
+ * When updating an existing volume (see setUpdating()), chunks which
+ * became empty are erased instead, so that no stale labels remain.
+ *
+ * Shapes, offsets and chunk indices are given in vigra order. The stored
+ * chunks are in C order of the reversed axes (edge chunks are padded to
+ * the full chunk shape), which is the layout of both HDF5 and Zarr.
+ */
+class ChunkedVolumeWriter {
+    public:
+    enum Codec {
+        None,       /**< uncompressed */
+        Gzip,       /**< deflate (zlib) */
+        ShuffleGzip /**< byte shuffle, then deflate */
+    };
+
+    /**
+     * Parses "none", "gzip" or "shuffle-gzip".
+     * Throws std::runtime_error for anything else.
+     */
+    static Codec parseCodec(const std::string& name);
+
+    /**
+     * The chunk shape a writer of a volume of the given shape uses for
+     * chunkShape: clipped to the volume, at least one voxel.
+     */
+    static vigra::Shape3 clipChunkShape(const vigra::Shape3& shape, const vigra::Shape3& chunkShape);
+
+    ChunkedVolumeWriter(const vigra::Shape3& shape, const vigra::Shape3& chunkShape, LabelType labelType,
+                        Codec codec, int level, int nThreads);
+    virtual ~ChunkedVolumeWriter() {}
+
+    /**
+     * Writes block to the part of the volume starting at offset.
+     * Block boundaries must fall on chunk boundaries (or on the end of
+     * the volume), and T must be the label type of the volume.
+     * Throws std::runtime_error on failure.
+     */
+    template<class T>
+    void write(const vigra::MultiArray<3, T>& block, const vigra::Shape3& offset);
+
+    virtual void close() = 0;
+
+    const vigra::Shape3& shape() const { return shape_; }
+    const vigra::Shape3& chunkShape() const { return chunkShape_; }
+    LabelType labelType() const { return labelType_; }
+
+    /** Uncompressed and stored bytes written so far. */
+    uint64_t rawBytes() const { return rawBytes_; }
+    uint64_t storedBytes() const { return storedBytes_; }
+
+    /** Number of chunks stored, and skipped because they were empty. */
+    uint64_t nChunksStored() const { return nChunksStored_; }
+    uint64_t nChunksSkipped() const { return nChunksSkipped_; }
+
+    /** Seconds spent in write() so far. */
+    double seconds() const { return seconds_; }
+
+    protected:
+    /**
+     * Stores the encoded chunk with the given chunk index.
+     * Called from the worker threads if storesConcurrently() returns
+     * true, otherwise from the calling thread in chunk order.
+     */
+    virtual void storeChunk(const vigra::Shape3& chunkIndex, const std::vector<char>& data) = 0;
+
+    virtual bool storesConcurrently() const = 0;
+
+    /**
+     * Makes the chunk with the given index read as zeros again, if it is
+     * stored. Returns false if the backend cannot remove it, a chunk of
+     * zeros is then stored instead. Called like storeChunk().
+     */
+    virtual bool eraseChunk(const vigra::Shape3& chunkIndex) = 0;
+
+    /** Whether write() may overwrite chunks which are already stored. */
+    void setUpdating(bool updating) { updating_ = updating; }
+
+    Codec codec() const { return codec_; }
+    int level() const { return level_; }
+
+    private:
+    ChunkedVolumeWriter(const ChunkedVolumeWriter&);
+    ChunkedVolumeWriter& operator=(const ChunkedVolumeWriter&);
+
+    template<class T>
+    bool encodeChunk(const vigra::MultiArray<3, T>& block, const vigra::Shape3& begin,
+                     std::vector<T>& buffer, std::vector<char>& out, bool keepEmpty = false) const;
+
+    vigra::Shape3 shape_;
+    vigra::Shape3 chunkShape_;
+    LabelType labelType_;
+    Codec codec_;
+    int level_;
+    int nThreads_;
+    bool updating_;
+    uint64_t rawBytes_;
+    uint64_t storedBytes_;
+    uint64_t nChunksStored_;
+    uint64_t nChunksSkipped_;
+    double seconds_;
+};
+
+#endif /* CHUNKEDVOLUMEWRITER_H */
@@ -26,6 +26,55 @@ std::istream& operator >>(std::istream& source, FloatBBox& target) {
     return source;
 }
 
+std::istream& operator >>(std::istream& source, IndexBBox& target) {
+    std::string in;
+    source >> in;
+    const std::string i = "([0-9]+)";
+    static const boost::regex e("\\("+i+","+i+","+i+"\\)\\("+i+","+i+","+i+"\\)");
+    boost::match_results<std::string::const_iterator> matches; 
+    
+    int num[6];
+    try {
+        if(!boost::regex_match(in, matches, e)) {
+            throw std::runtime_error("no match");
+        }
+        for(size_t i=1; i<matches.size(); ++i) {
+            num[i-1] = boost::lexical_cast<int>(std::string(matches[i].first, matches[i].second));
+        }
+        target = IndexBBox(vigra::Shape3(num[0], num[1], num[2]), vigra::Shape3(num[3], num[4], num[5]));
+    }
+    catch(const std::exception& e) {
+        std::stringstream err;
+        err << "Could not parse '" << in << "' as an integer bounding box" << std::endl;
+        throw std::runtime_error(err.str());
+    }
+    return source;
+}
+
+std::istream& operator >>(std::istream& source, TileIndex& target) {
+    std::string in;
+    source >> in;
+    static const boost::regex e("([0-9]+)/([0-9]+)");
+    boost::match_results<std::string::const_iterator> matches; 
+    
+    try {
+        if(!boost::regex_match(in, matches, e)) {
+            throw std::runtime_error("no match");
+        }
+        target = TileIndex(boost::lexical_cast<int>(std::string(matches[1].first, matches[1].second)),
+                           boost::lexical_cast<int>(std::string(matches[2].first, matches[2].second)));
+        if(target.count < 1 || target.index >= target.count) {
+            throw std::runtime_error("out of range");
+        }
+    }
+    catch(const std::exception& e) {
+        std::stringstream err;
+        err << "Could not parse '" << in << "' as a tile 'i/N' with 0 <= i < N" << std::endl;
+        throw std::runtime_error(err.str());
+    }
+    return source;
+}
+
 namespace vigra {
 std::istream& operator >>(std::istream& source, vigra::Shape3& target) {
     std::string in;
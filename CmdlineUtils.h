@@ -13,7 +13,26 @@ class FloatBBox {
     Vector3 stop;
 };
 
+class IndexBBox {
+    public:
+    IndexBBox() {}
+    IndexBBox(const vigra::Shape3& s, const vigra::Shape3& t) : start(s), stop(t) {}
+    vigra::Shape3 start;
+    vigra::Shape3 stop;
+};
+
+/** Tile index of count tiles, written as 'index/count'. */
+class TileIndex {
+    public:
+    TileIndex() : index(0), count(1) {}
+    TileIndex(int i, int n) : index(i), count(n) {}
+    int index;
+    int count;
+};
+
 std::istream& operator >>(std::istream& source, FloatBBox& target);
+std::istream& operator >>(std::istream& source, IndexBBox& target);
+std::istream& operator >>(std::istream& source, TileIndex& target);
 
 namespace vigra {
     std::istream& operator >>(std::istream& source, vigra::Shape3& target);
@@ -0,0 +1,156 @@
+#include "HDF5ChunkWriter.h"
+
+#include <stdexcept>
+
+#include <unistd.h>
+
+#if !H5_VERSION_GE(1, 10, 3)
+// before HDF5 1.10.3, direct chunk writes were part of the high level library
+#include <hdf5_hl.h>
+#define H5Dwrite_chunk H5DOwrite_chunk
+#endif
+
+static hid_t nativeType(LabelType type)
+{
+    switch(type) {
+        case Label8:  return H5T_NATIVE_UINT8;
+        case Label16: return H5T_NATIVE_UINT16;
+        default:      return H5T_NATIVE_UINT32;
+    }
+}
+
+HDF5ChunkWriter::HDF5ChunkWriter(const std::string& filename, const std::string& dataset,
+                                 const vigra::Shape3& shape, const vigra::Shape3& chunkShape, LabelType labelType,
+                                 Codec codec, int level, int nThreads, bool update)
+    : ChunkedVolumeWriter(shape, chunkShape, labelType, codec, level, nThreads),
+      file_(-1), dataset_(-1)
+{
+    if(update && ::access(filename.c_str(), F_OK) == 0) {
+        file_ = H5Fopen(filename.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+        if(file_ < 0) {
+            throw std::runtime_error("could not open '" + filename + "' for writing");
+        }
+        if(H5Lexists(file_, dataset.c_str(), H5P_DEFAULT) > 0) {
+            openDataset(filename, dataset);
+            setUpdating(true);
+            return;
+        }
+    }
+    else {
+        file_ = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        if(file_ < 0) {
+            throw std::runtime_error("could not create '" + filename + "'");
+        }
+    }
+
+    hsize_t dims[3], chunkDims[3];
+    for(int i=0; i<3; ++i) {
+        dims[2-i] = this->shape()[i];
+        chunkDims[2-i] = this->chunkShape()[i];
+    }
+
+    const hid_t space = H5Screate_simple(3, dims, 0);
+    const hid_t props = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(props, 3, chunkDims);
+    if(codec == ShuffleGzip) {
+        H5Pset_shuffle(props);
+    }
+    if(codec != None) {
+        H5Pset_deflate(props, level);
+    }
+    const uint64_t fill = 0;
+    H5Pset_fill_value(props, H5T_NATIVE_UINT64, &fill);
+    dataset_ = H5Dcreate2(file_, dataset.c_str(), nativeType(labelType), space, H5P_DEFAULT, props, H5P_DEFAULT);
+    H5Pclose(props);
+    H5Sclose(space);
+    if(dataset_ < 0) {
+        close();
+        throw std::runtime_error("could not create dataset '" + dataset + "' in '" + filename + "'");
+    }
+}
+
+void HDF5ChunkWriter::openDataset(const std::string& filename, const std::string& dataset)
+{
+    dataset_ = H5Dopen2(file_, dataset.c_str(), H5P_DEFAULT);
+    if(dataset_ < 0) {
+        close();
+        throw std::runtime_error("could not open dataset '" + dataset + "' in '" + filename + "'");
+    }
+
+    // chunks are written as they are encoded here, so the layout and the
+    // filters of the dataset have to match exactly
+    hsize_t dims[3] = {0, 0, 0}, chunkDims[3] = {0, 0, 0};
+    const hid_t space = H5Dget_space(dataset_);
+    const bool shapeMatches = H5Sget_simple_extent_ndims(space) == 3;
+    if(shapeMatches) {
+        H5Sget_simple_extent_dims(space, dims, 0);
+    }
+    H5Sclose(space);
+    const hid_t props = H5Dget_create_plist(dataset_);
+    const bool chunked = H5Pget_layout(props) == H5D_CHUNKED && H5Pget_chunk(props, 3, chunkDims) == 3;
+    const int nFilters = H5Pget_nfilters(props);
+    H5Pclose(props);
+    const hid_t type = H5Dget_type(dataset_);
+    const bool typeMatches = H5Tequal(type, nativeType(labelType())) > 0;
+    H5Tclose(type);
+
+    bool matches = shapeMatches && chunked && typeMatches
+                   && nFilters == (codec() == None ? 0 : codec() == Gzip ? 1 : 2);
+    for(int i=0; i<3; ++i) {
+        matches = matches && dims[2-i] == hsize_t(shape()[i]) && chunkDims[2-i] == hsize_t(chunkShape()[i]);
+    }
+    if(!matches) {
+        close();
+        throw std::runtime_error("dataset '" + dataset + "' in '" + filename
+                                 + "' does not match the shape, chunks, type or codec of the output");
+    }
+}
+
+HDF5ChunkWriter::~HDF5ChunkWriter()
+{
+    close();
+}
+
+void HDF5ChunkWriter::close()
+{
+    if(dataset_ >= 0) {
+        H5Dclose(dataset_);
+        dataset_ = -1;
+    }
+    if(file_ >= 0) {
+        H5Fclose(file_);
+        file_ = -1;
+    }
+}
+
+void HDF5ChunkWriter::storeChunk(const vigra::Shape3& chunkIndex, const std::vector<char>& data)
+{
+    hsize_t offset[3];
+    for(int i=0; i<3; ++i) {
+        offset[2-i] = chunkIndex[i] * chunkShape()[i];
+    }
+    if(H5Dwrite_chunk(dataset_, H5P_DEFAULT, 0, offset, data.size(), data.data()) < 0) {
+        throw std::runtime_error("HDF5ChunkWriter: could not write chunk");
+    }
+}
+
+bool HDF5ChunkWriter::eraseChunk(const vigra::Shape3& chunkIndex)
+{
+    // HDF5 cannot free a chunk, but there is nothing to do if it was
+    // never allocated
+#if H5_VERSION_GE(1, 10, 2)
+    hsize_t offset[3];
+    for(int i=0; i<3; ++i) {
+        offset[2-i] = chunkIndex[i] * chunkShape()[i];
+    }
+    hsize_t size = 0;
+    H5E_BEGIN_TRY {
+        if(H5Dget_chunk_storage_size(dataset_, offset, &size) < 0) {
+            size = 0;
+        }
+    } H5E_END_TRY;
+    return size == 0;
+#else
+    return false;
+#endif
+}
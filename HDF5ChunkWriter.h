@@ -0,0 +1,53 @@
+#ifndef HDF5CHUNKWRITER_H
+#define HDF5CHUNKWRITER_H
+
+#include <string>
+
+#include <hdf5.h>
+
+#include "ChunkedVolumeWriter.h"
+
+/**
+ * Writes the label volume into a chunked HDF5 dataset. The chunks are
+ * compressed in parallel (see ChunkedVolumeWriter) and stored with
+ * direct chunk writes, bypassing HDF5's own single threaded filter
+ * pipeline.
+ *
+ * The dataset carries the usual filter settings, so any HDF5 reader can
+ * decompress it. Empty chunks are left unallocated and read as zeros.
+ */
+class HDF5ChunkWriter : public ChunkedVolumeWriter {
+    public:
+    /**
+     * Creates (or truncates) filename and the dataset of the given shape
+     * and label type.
+     * With update, an existing file is opened instead and its dataset,
+     * which must have the same shape, chunks, type and filters, is written
+     * into; chunks outside of the written blocks are kept, empty ones
+     * inside are overwritten with zeros. This lets
+     * several runs fill disjoint regions of one volume, one after the
+     * other (HDF5 files cannot be written by several processes at once).
+     * If the file has no such dataset yet, it is added, so several
+     * writers can fill different datasets of one file.
+     * Throws std::runtime_error on failure.
+     */
+    HDF5ChunkWriter(const std::string& filename, const std::string& dataset,
+                    const vigra::Shape3& shape, const vigra::Shape3& chunkShape, LabelType labelType,
+                    Codec codec, int level, int nThreads, bool update = false);
+    ~HDF5ChunkWriter();
+
+    void close();
+
+    protected:
+    void storeChunk(const vigra::Shape3& chunkIndex, const std::vector<char>& data);
+    bool storesConcurrently() const { return false; }
+    bool eraseChunk(const vigra::Shape3& chunkIndex);
+
+    private:
+    void openDataset(const std::string& filename, const std::string& dataset);
+
+    hid_t file_;
+    hid_t dataset_;
+};
+
+#endif /* HDF5CHUNKWRITER_H */
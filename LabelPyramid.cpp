@@ -0,0 +1,79 @@
+#include "LabelPyramid.h"
+
+#include <algorithm>
+
+#include "Parallel.h"
+
+vigra::Shape3 pyramidShape(const vigra::Shape3& shape, int scale)
+{
+    const vigra::MultiArrayIndex f = vigra::MultiArrayIndex(1) << scale;
+    return vigra::Shape3((shape[0] + f - 1) / f, (shape[1] + f - 1) / f, (shape[2] + f - 1) / f);
+}
+
+bool pyramidFits(const vigra::Shape3& shape, const vigra::Shape3& chunkShape, int nScales)
+{
+    const vigra::MultiArrayIndex f = vigra::MultiArrayIndex(1) << nScales;
+    for(int i=0; i<3; ++i) {
+        if(chunkShape[i] % f != 0 && chunkShape[i] < shape[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Most frequent of the n (1 to 8) labels in v, see LabelPyramid.h for ties.
+template<class T>
+static T mode(T* v, int n)
+{
+    if(std::count(v, v + n, v[0]) == n) {
+        return v[0];
+    }
+    // insertion sort, there are at most 8 labels
+    for(int i=1; i<n; ++i) {
+        const T x = v[i];
+        int j = i;
+        for(; j>0 && v[j-1] > x; --j) {
+            v[j] = v[j-1];
+        }
+        v[j] = x;
+    }
+    T best = v[0];
+    int bestCount = 0;
+    for(int i=0, j; i<n; i=j) {
+        for(j=i+1; j<n && v[j] == v[i]; ++j) {}
+        // v is sorted, so a later run of the same length has a larger label
+        if(j - i > bestCount || (j - i == bestCount && best == 0)) {
+            best = v[i];
+            bestCount = j - i;
+        }
+    }
+    return best;
+}
+
+template<class T>
+void downsampleLabels(const vigra::MultiArray<3, T>& in, vigra::MultiArray<3, T>& out, int nThreads)
+{
+    const vigra::Shape3 s = in.shape();
+    out.reshape(pyramidShape(s, 1));
+    // planes of out are independent, and each reads two planes of in
+    parallelFor(out.shape(2), nThreads, [&](size_t k, int) {
+        T v[8];
+        for(vigra::MultiArrayIndex j=0; j<out.shape(1); ++j) {
+            for(vigra::MultiArrayIndex i=0; i<out.shape(0); ++i) {
+                int n = 0;
+                for(vigra::MultiArrayIndex z=2*k; z<std::min<vigra::MultiArrayIndex>(2*k+2, s[2]); ++z) {
+                    for(vigra::MultiArrayIndex y=2*j; y<std::min(2*j+2, s[1]); ++y) {
+                        for(vigra::MultiArrayIndex x=2*i; x<std::min(2*i+2, s[0]); ++x) {
+                            v[n++] = in(x, y, z);
+                        }
+                    }
+                }
+                out(i, j, k) = mode(v, n);
+            }
+        }
+    });
+}
+
+template void downsampleLabels(const vigra::MultiArray<3, uint8_t>&, vigra::MultiArray<3, uint8_t>&, int);
+template void downsampleLabels(const vigra::MultiArray<3, uint16_t>&, vigra::MultiArray<3, uint16_t>&, int);
+template void downsampleLabels(const vigra::MultiArray<3, uint32_t>&, vigra::MultiArray<3, uint32_t>&, int);
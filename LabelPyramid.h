@@ -0,0 +1,40 @@
+#ifndef LABELPYRAMID_H
+#define LABELPYRAMID_H
+
+#include <stdint.h>
+
+#include <vigra/multi_array.hxx>
+
+/**
+ * Downsampling of label volumes for multi-resolution pyramids.
+ *
+ * Scale s of a volume of shape n has shape ceil(n / 2^s) and is computed
+ * from scale s-1 by mode downsampling: each voxel gets the most frequent
+ * label of the 2x2x2 block it covers (fewer voxels at the upper edges).
+ * Ties are broken in favour of objects over the background (0), then
+ * of the smaller label, so thin objects do not vanish too early.
+ *
+ * A block of scale 0 starting at a multiple of 2^s (along every axis)
+ * can be downsampled on its own and lands in scale s at offset / 2^s,
+ * e.g. each slab of whole chunks of the output, as long as the chunk
+ * shape is a multiple of 2^s (see pyramidFits()).
+ */
+
+/** Shape of scale `scale` of a volume (or chunk) of the given shape. */
+vigra::Shape3 pyramidShape(const vigra::Shape3& shape, int scale);
+
+/**
+ * Whether blocks of whole chunks of chunkShape can be downsampled on
+ * their own to nScales further scales, i.e. whether every chunk
+ * dimension is a multiple of 2^nScales or covers the whole volume.
+ */
+bool pyramidFits(const vigra::Shape3& shape, const vigra::Shape3& chunkShape, int nScales);
+
+/**
+ * Computes the next scale of in into out (reshaped as necessary), using
+ * nThreads threads. T is any of the label types in LabelType.h.
+ */
+template<class T>
+void downsampleLabels(const vigra::MultiArray<3, T>& in, vigra::MultiArray<3, T>& out, int nThreads);
+
+#endif /* LABELPYRAMID_H */
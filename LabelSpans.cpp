@@ -0,0 +1,72 @@
+#include "LabelSpans.h"
+
+#include <algorithm>
+
+void RayLabelSpans::paint(int32_t begin, int32_t end, uint32_t label)
+{
+    if(begin >= end) {
+        return;
+    }
+
+    // common case: the spans of a ray are painted front to back
+    if(spans_.empty() || spans_.back().end <= begin) {
+        if(!spans_.empty() && spans_.back().end == begin && spans_.back().label == label) {
+            spans_.back().end = end;
+            return;
+        }
+        LabelSpan s;
+        s.begin = begin;
+        s.end = end;
+        s.label = label;
+        spans_.push_back(s);
+        return;
+    }
+
+    // first span which ends after begin, and first span starting at or after end
+    auto first = std::lower_bound(spans_.begin(), spans_.end(), begin,
+        [](const LabelSpan& s, int32_t b) { return s.end <= b; });
+    auto last = std::lower_bound(first, spans_.end(), end,
+        [](const LabelSpan& s, int32_t e) { return s.begin < e; });
+
+    // keep the parts of the overlapped spans outside of [begin, end)
+    LabelSpan replacement[3];
+    int n = 0;
+    if(first != last && first->begin < begin) {
+        replacement[n] = *first;
+        replacement[n].end = begin;
+        ++n;
+    }
+    replacement[n].begin = begin;
+    replacement[n].end = end;
+    replacement[n].label = label;
+    ++n;
+    if(first != last && (last-1)->end > end) {
+        replacement[n] = *(last-1);
+        replacement[n].begin = end;
+        ++n;
+    }
+
+    const std::ptrdiff_t pos = first - spans_.begin();
+    spans_.erase(first, last);
+    spans_.insert(spans_.begin() + pos, replacement, replacement + n);
+}
+
+template<class T>
+void RayLabelSpans::fill(T* line, int32_t first, std::ptrdiff_t stride) const
+{
+    for(const LabelSpan& s : spans_) {
+        T* p = line + (s.begin - first)*stride;
+        const T label = static_cast<T>(s.label);
+        if(stride == 1) {
+            std::fill(p, p + (s.end - s.begin), label);
+            continue;
+        }
+        for(int32_t i = s.begin; i < s.end; ++i, p += stride) {
+            *p = label;
+        }
+    }
+}
+
+template void RayLabelSpans::fill(uint8_t*, int32_t, std::ptrdiff_t) const;
+template void RayLabelSpans::fill(uint16_t*, int32_t, std::ptrdiff_t) const;
+template void RayLabelSpans::fill(uint32_t*, int32_t, std::ptrdiff_t) const;
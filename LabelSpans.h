@@ -0,0 +1,52 @@
+#ifndef LABELSPANS_H
+#define LABELSPANS_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * The voxels [begin, end) along a ray line which carry label.
+ */
+struct LabelSpan {
+    int32_t begin;
+    int32_t end;
+    uint32_t label;
+};
+
+/**
+ * Labels of the voxels along one ray line as a sorted list of disjoint
+ * spans; all voxels outside of them are background (0).
+ *
+ * The tracer paints the inside of every object it hits along the ray
+ * into such a list and only expands it into the dense label volume once
+ * the ray is done. On mostly empty scenes, a ray line then costs a
+ * few spans instead of a write per voxel.
+ */
+class RayLabelSpans {
+    public:
+    void clear() { spans_.clear(); }
+    bool empty() const { return spans_.empty(); }
+
+    /**
+     * Labels [begin, end) with label, overwriting the labels painted
+     * before, like the corresponding writes to a dense line would.
+     */
+    void paint(int32_t begin, int32_t end, uint32_t label);
+
+    const std::vector<LabelSpan>& spans() const { return spans_; }
+
+    /**
+     * Writes the labels of all spans to line[(i - first)*stride], for
+     * every voxel i of a span. Background voxels are not touched.
+     * T is any of the label types (see LabelType.h), which must be
+     * able to hold the labels.
+     */
+    template<class T>
+    void fill(T* line, int32_t first, std::ptrdiff_t stride) const;
+
+    private:
+    std::vector<LabelSpan> spans_;
+};
+
+#endif /* LABELSPANS_H */
@@ -0,0 +1,38 @@
+#include "LabelType.h"
+
+#include <sstream>
+#include <stdexcept>
+
+LabelType labelTypeFor(uint64_t nObjects)
+{
+    if(nObjects <= 0xffu) {
+        return Label8;
+    }
+    if(nObjects <= 0xffffu) {
+        return Label16;
+    }
+    if(nObjects <= 0xffffffffu) {
+        return Label32;
+    }
+    std::stringstream ss;
+    ss << nObjects << " objects do not fit into 32 bit labels";
+    throw std::runtime_error(ss.str());
+}
+
+size_t labelSize(LabelType type)
+{
+    switch(type) {
+        case Label8:  return 1;
+        case Label16: return 2;
+        default:      return 4;
+    }
+}
+
+const char* labelTypeName(LabelType type)
+{
+    switch(type) {
+        case Label8:  return "uint8";
+        case Label16: return "uint16";
+        default:      return "uint32";
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef LABELTYPE_H
+#define LABELTYPE_H
+
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * The unsigned integer types label volumes are stored in.
+ *
+ * Labels run from 0 (background) to the number of objects, so a scene
+ * of fewer than 256 objects fits into one byte per voxel, one of up to
+ * 65535 into two, and up to 2^32-1 into four. Objects are numbered
+ * with 32 bit integers throughout (meshes, spans, scene hits), so there
+ * is no wider type. The tracing, voting, downsampling and writing code
+ * is templated on the C++ type of the labels and instantiated for all
+ * three (see LabelTypeOf).
+ */
+enum LabelType {
+    Label8,  /**< uint8_t */
+    Label16, /**< uint16_t */
+    Label32  /**< uint32_t */
+};
+
+/**
+ * The narrowest label type holding the labels of nObjects objects.
+ * Throws std::runtime_error for more than 2^32-1 objects.
+ */
+LabelType labelTypeFor(uint64_t nObjects);
+
+/** Size of a label of the given type in bytes. */
+size_t labelSize(LabelType type);
+
+/** "uint8", "uint16" or "uint32". */
+const char* labelTypeName(LabelType type);
+
+/** Maps the C++ type of the labels to its LabelType. */
+template<class T> struct LabelTypeOf;
+template<> struct LabelTypeOf<uint8_t>  { static const LabelType value = Label8; };
+template<> struct LabelTypeOf<uint16_t> { static const LabelType value = Label16; };
+template<> struct LabelTypeOf<uint32_t> { static const LabelType value = Label32; };
+
+#endif /* LABELTYPE_H */
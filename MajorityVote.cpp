@@ -0,0 +1,87 @@
+#include "MajorityVote.h"
+
+#include <algorithm>
+#include <cstring>
+
+template<class T>
+MajorityVote<T>::MajorityVote(Labels out)
+    : out_(out)
+{
+}
+
+template<class T>
+void MajorityVote<T>::addSecond(const Labels& block, const vigra::Shape3& offset)
+{
+    std::vector<Undecided> undecided;
+    const vigra::MultiArrayIndex n = block.shape(0);
+    vigra::Shape3 c;
+    for(c[2]=0; c[2]<block.shape(2); ++c[2]) {
+        for(c[1]=0; c[1]<block.shape(1); ++c[1]) {
+            const size_t first = index(offset + c);
+            const T* a = out_.data() + first;
+            const T* b = &block(0, c[1], c[2]);
+            // rows are contiguous and mostly agree, which the vectorized
+            // memcmp checks much faster than the loop below
+            if(std::memcmp(a, b, n*sizeof(T)) == 0) {
+                continue;
+            }
+            for(vigra::MultiArrayIndex i=0; i<n; ++i) {
+                if(a[i] != b[i]) {
+                    Undecided u;
+                    u.index = first + i;
+                    u.second = b[i];
+                    undecided.push_back(u);
+                }
+            }
+        }
+    }
+    if(undecided.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    undecided_.insert(undecided_.end(), undecided.begin(), undecided.end());
+}
+
+template<class T>
+void MajorityVote<T>::finishSecond()
+{
+    std::sort(undecided_.begin(), undecided_.end());
+    undecidedMask_.assign((out_.size() + 63) / 64, 0);
+    for(const Undecided& u : undecided_) {
+        undecidedMask_[u.index / 64] |= uint64_t(1) << (u.index % 64);
+    }
+}
+
+template<class T>
+void MajorityVote<T>::addThird(const Labels& block, const vigra::Shape3& offset)
+{
+    if(undecided_.empty()) {
+        return;
+    }
+    T* out = out_.data();
+    vigra::Shape3 c;
+    for(c[2]=0; c[2]<block.shape(2); ++c[2]) {
+        for(c[1]=0; c[1]<block.shape(1); ++c[1]) {
+            const size_t first = index(offset + c);
+            const T* row = &block(0, c[1], c[2]);
+            for(vigra::MultiArrayIndex i=0; i<block.shape(0); ++i) {
+                const size_t k = first + i;
+                if(!(undecidedMask_[k / 64] & (uint64_t(1) << (k % 64)))) {
+                    continue;
+                }
+                Undecided key;
+                key.index = k;
+                const T a = out[k];
+                const T b = std::lower_bound(undecided_.begin(), undecided_.end(), key)->second;
+                const T third = row[i];
+                if     ( a == third ) { out[k] = a; }
+                else if( b == third ) { out[k] = b; }
+                else                  { out[k] = 0; }
+            }
+        }
+    }
+}
+
+template class MajorityVote<uint8_t>;
+template class MajorityVote<uint16_t>;
+template class MajorityVote<uint32_t>;
@@ -0,0 +1,75 @@
+#ifndef MAJORITYVOTE_H
+#define MAJORITYVOTE_H
+
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+#include <vigra/multi_array.hxx>
+
+/**
+ * Majority vote over the labels a, b, c which the rays along the first,
+ * second and third axis assign to each voxel, folded into a single
+ * output volume while the labels are produced:
+ *
+ *   a if a == b or a == c, b if b == c, 0 otherwise.
+ *
+ * The labels of the first axis are written directly into the output.
+ * Blocks of labels of the second axis are then compared against it with
+ * addSecond(). Where they agree, the vote is already decided; only the
+ * voxels where they differ are remembered, in a sorted list and a packed
+ * bit mask (see finishSecond()). addThird() finally resolves these
+ * voxels from blocks of labels of the third axis.
+ *
+ * Besides the output, this needs one bit per voxel and an index and a
+ * label per undecided voxel, instead of two more full label volumes.
+ * addSecond() and addThird() may be called concurrently for disjoint
+ * blocks.
+ *
+ * T is the label type, any of those in LabelType.h.
+ */
+template<class T>
+class MajorityVote {
+    public:
+    typedef vigra::MultiArrayView<3, T, vigra::UnstridedArrayTag> Labels;
+
+    /** out must hold the labels of the first axis and outlive the vote. */
+    explicit MajorityVote(Labels out);
+
+    /**
+     * Compares the labels of the second axis for the block of out
+     * starting at offset (in vigra order) against the first axis.
+     */
+    void addSecond(const Labels& block, const vigra::Shape3& offset);
+
+    /** Must be called after all blocks of the second axis were added. */
+    void finishSecond();
+
+    /**
+     * Resolves the undecided voxels of the block of out starting at
+     * offset with the labels of the third axis.
+     */
+    void addThird(const Labels& block, const vigra::Shape3& offset);
+
+    /** Number of voxels which were undecided after the second axis. */
+    size_t nUndecided() const { return undecided_.size(); }
+
+    private:
+    struct Undecided {
+        size_t index; // into out, which can exceed 2^32 voxels
+        T second;
+
+        bool operator<(const Undecided& other) const { return index < other.index; }
+    };
+
+    size_t index(const vigra::Shape3& c) const {
+        return c[0] + out_.shape(0)*(c[1] + out_.shape(1)*c[2]);
+    }
+
+    Labels out_;
+    std::vector<Undecided> undecided_;
+    std::vector<uint64_t> undecidedMask_;
+    std::mutex mutex_;
+};
+
+#endif /* MAJORITYVOTE_H */
@@ -0,0 +1,48 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& filename, bool sequential)
+    : data_(0), size_(0)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || ::fstat(fd, &st) != 0) {
+        std::stringstream ss;
+        ss << "could not open '" << filename << "': " << std::strerror(errno);
+        if(fd >= 0) {
+            ::close(fd);
+        }
+        throw std::runtime_error(ss.str());
+    }
+    size_ = st.st_size;
+    if(size_ > 0) {
+        void* p = ::mmap(0, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) {
+            std::stringstream ss;
+            ss << "could not map '" << filename << "': " << std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error(ss.str());
+        }
+        if(sequential) {
+            ::madvise(p, size_, MADV_SEQUENTIAL);
+        }
+        data_ = static_cast<const char*>(p);
+    }
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if(data_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+}
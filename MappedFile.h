@@ -0,0 +1,30 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+/**
+ * Read-only memory mapping of a whole file.
+ */
+class MappedFile {
+    public:
+    /**
+     * Maps filename, throws std::runtime_error if that fails.
+     * sequential tells the kernel to read ahead and drop pages behind,
+     * for files which are read once from start to end.
+     */
+    MappedFile(const std::string& filename, bool sequential = true);
+    ~MappedFile();
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* data_;
+    size_t size_;
+};
+
+#endif /* MAPPEDFILE_H */
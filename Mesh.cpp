@@ -1,5 +1,9 @@
 #include "Mesh.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 #include "Triangle.h"
 
 BBox Mesh::bbox() const
@@ -7,37 +11,140 @@ BBox Mesh::bbox() const
     if(vertices.size() == 0) {
         return BBox();
     }
-    else if(vertices.size() == 1) {
-        return BBox(vertices[0], vertices[0]);
+    BBox b(vertices[0]);
+    for(const Vector3& v : vertices) {
+        b.expandToInclude(v);
+    }
+    return b;
+}
+
+bool Mesh::buildBVH(float edgeLengthThreshold, int nThreads)
+{
+    std::vector<Triangle> triangles;
+    size_t tris = appendTriangles(triangles, edgeLengthThreshold);
+    if(tris > 0) { 
+        bvh_ = std::unique_ptr<MeshBVH>(new MeshBVH(std::move(triangles), 4, nThreads));
+        return true;
+    }
+    return false;
+}
+
+bool Mesh::buildCompactBVH(float edgeLengthThreshold, const VertexGrid* grid, int nThreads)
+{
+    // the vertices of the faces kept, keyed by their position (float
+    // bits or grid coordinates), in face order
+    typedef std::array<int64_t, 3> Key;
+    std::vector<std::pair<Key, uint32_t> > corners;
+    for(const auto& f : faces) {
+        const Vector3& v1 = vertices[f[0]];
+        const Vector3& v2 = vertices[f[1]];
+        const Vector3& v3 = vertices[f[2]];
+        const float l = std::max(length(v2-v1), std::max(length(v2-v3), length(v1-v3)));
+        if(edgeLengthThreshold > 0 && l > edgeLengthThreshold) {
+            continue;
+        }
+        for(int c=0; c<3; ++c) {
+            const Vector3& v = vertices[f[c]];
+            Key key;
+            for(int k=0; k<3; ++k) {
+                if(grid) {
+                    key[k] = int64_t(std::floor((double(v[k]) - grid->start[k]) / grid->step[k] + 0.5));
+                }
+                else {
+                    uint32_t bits;
+                    std::memcpy(&bits, &v[k], sizeof(bits));
+                    key[k] = bits;
+                }
+            }
+            corners.push_back(std::make_pair(key, uint32_t(corners.size())));
+        }
+    }
+
+    int64_t lo[3] = {0, 0, 0};
+    bool quantize = grid != 0 && !corners.empty();
+    if(quantize) {
+        int64_t hi[3];
+        for(int k=0; k<3; ++k) {
+            lo[k] = hi[k] = corners[0].first[k];
+        }
+        for(const auto& c : corners) {
+            for(int k=0; k<3; ++k) {
+                lo[k] = std::min(lo[k], c.first[k]);
+                hi[k] = std::max(hi[k], c.first[k]);
+            }
+        }
+        for(int k=0; k<3; ++k) {
+            quantize = quantize && hi[k] - lo[k] <= 0xffff;
+        }
+        if(!quantize) {
+            return buildCompactBVH(edgeLengthThreshold, 0, nThreads);
+        }
+    }
+
+    // weld: number the distinct keys, in order of their first corner
+    std::vector<std::pair<Key, uint32_t> > sorted(corners);
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<uint32_t> weldedIndex(corners.size());
+    std::vector<uint32_t> firstCorner;
+    for(size_t i=0; i<sorted.size(); ++i) {
+        if(i == 0 || sorted[i].first != sorted[i-1].first) {
+            firstCorner.push_back(sorted[i].second);
+        }
+        weldedIndex[sorted[i].second] = uint32_t(firstCorner.size() - 1);
+    }
+
+    std::vector<uint32_t> indices;
+    indices.reserve(corners.size());
+    for(size_t i=0; i<corners.size(); i+=3) {
+        const uint32_t a = weldedIndex[i], b = weldedIndex[i+1], c = weldedIndex[i+2];
+        if(a == b || b == c || a == c) {
+            continue;
+        }
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+    if(indices.empty()) {
+        return false;
+    }
+
+    TriangleStore store;
+    if(quantize) {
+        std::vector<uint16_t> q(3*firstCorner.size());
+        for(size_t v=0; v<firstCorner.size(); ++v) {
+            for(int k=0; k<3; ++k) {
+                q[3*v+k] = uint16_t(corners[firstCorner[v]].first[k] - lo[k]);
+            }
+        }
+        const int32_t base[3] = {int32_t(lo[0]), int32_t(lo[1]), int32_t(lo[2])};
+        store = TriangleStore(std::move(indices), std::move(q), *grid, base);
     }
     else {
-        auto it = vertices.begin();
-        BBox b(*it, *(++it));
-        while(it != vertices.end()) {
-            b.expandToInclude(*it);
-            ++it;
+        std::vector<float> v(3*firstCorner.size());
+        for(size_t i=0; i<firstCorner.size(); ++i) {
+            for(int k=0; k<3; ++k) {
+                const int64_t bits = corners[firstCorner[i]].first[k];
+                const uint32_t b = uint32_t(bits);
+                std::memcpy(&v[3*i+k], &b, sizeof(float));
+            }
         }
-        return b;
+        store = TriangleStore(std::move(indices), std::move(v));
     }
+    bvh_ = std::unique_ptr<MeshBVH>(new MeshBVH(std::move(store), 4, nThreads));
+    return true;
 }
 
-//Mesh::~Mesh()
-//{
-//    for(Object* o : objects_) {
-//        delete o;
-//    }
-//}
-
-bool Mesh::buildBVH(float edgeLengthThreshold)
+size_t Mesh::appendTriangles(std::vector<Object*>& objects, float edgeLengthTreshold=-1.0) const
 {
-    size_t tris = appendTriangles(objects_, edgeLengthThreshold);
-    if(tris > 0) { 
-        std::cout << "building BVH with " << tris << " / " << faces.size() << " tris after filtering" << std::endl;
-        bvh_ = std::unique_ptr<BVH>(new BVH(&objects_));
+    std::vector<Triangle> triangles;
+    size_t n = appendTriangles(triangles, edgeLengthTreshold);
+    for(const auto& t : triangles) {
+        objects.push_back(new Triangle(t));
     }
+    return n;
 }
 
-size_t Mesh::appendTriangles(std::vector<Object*>& objects, float edgeLengthTreshold=-1.0) const
+size_t Mesh::appendTriangles(std::vector<Triangle>& triangles, float edgeLengthTreshold) const
 {
     size_t i = 0;
     for(const auto& f : faces) {
@@ -54,26 +161,26 @@ size_t Mesh::appendTriangles(std::vector<Object*>& objects, float edgeLengthTres
             continue;
         }
         
-        objects.push_back(new Triangle(v1, v2, v3, label_) );
+        triangles.push_back(Triangle(v1, v2, v3, label_));
         ++i;
     }
     return i;
 }
 
-bool Mesh::contains(const Vector3& p, const BVH& bvh) const
+bool Mesh::contains(const Vector3& p, std::vector<RayHit>& hits) const
 {
-    bool hit = false;
-    int nHits = 0;
-    Vector3 rayStart = p;
-    do {
-        Ray ray(rayStart, Vector3(0,0,1));
-        IntersectionInfo I;
-        hit = bvh.getIntersection(ray, &I, false);
-        ++nHits;
-        rayStart = I.hit + 0.001*ray.d; 
+    if(!bvh_) {
+        return false;
     }
-    while(hit);
-    return (nHits % 2) == 1;
+    Ray ray(p, Vector3(0,0,1));
+    bvh_->getAllIntersections(ray, hits);
+    return (hits.size() % 2) == 1;
+}
+
+bool Mesh::contains(const Vector3& p) const
+{
+    std::vector<RayHit> hits;
+    return contains(p, hits);
 }
 
 /*
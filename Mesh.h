@@ -6,16 +6,15 @@
 #include <memory>
 
 #include "fastbvh/BBox.h"
-#include "fastbvh/BVH.h"
 #include "fastbvh/Object.h"
 #include "fastbvh/Vector3.h"
 
+#include "MeshBVH.h"
+
 class Mesh {
     public:
     typedef std::array<uint32_t, 3> Tri;
     
-    //~Mesh();
-    
     std::vector<Vector3> vertices;
     std::vector<Tri> faces;
     
@@ -27,17 +26,44 @@ class Mesh {
     void setLabel(uint32_t label) { label_ = label; }
     uint32_t label() const { return label_; }
    
+    /**
+     * Appends newly allocated triangles of this mesh to objects, which
+     * then own them.
+     */
     size_t appendTriangles(std::vector<Object*>& objects, float edgeLengthThreshold) const;
     
-    bool contains(const Vector3& p, const BVH& bvh) const;
+    /**
+     * Returns whether p lies inside the mesh (requires buildBVH).
+     * hits is used as scratch space and can be reused between calls.
+     */
+    bool contains(const Vector3& p, std::vector<RayHit>& hits) const;
+    bool contains(const Vector3& p) const;
     
-    bool buildBVH(float edgeLengthThreshold);
+    /**
+     * Builds the BVH over all faces whose longest edge is at most
+     * edgeLengthThreshold (all faces if it is negative), using up to
+     * nThreads threads. Returns false if no face was left.
+     */
+    bool buildBVH(float edgeLengthThreshold, int nThreads = 1);
+
+    /**
+     * Like buildBVH, but keeps the triangles in a compact layout of
+     * TriangleStore: vertices at the same position are welded into one,
+     * which all of their triangles reference. With a grid, the vertices
+     * are first snapped to the nearest grid point and stored as 16 bit
+     * grid coordinates; a mesh spanning more than 65536 grid points
+     * along an axis keeps float vertices. Faces which became degenerate
+     * are dropped.
+     */
+    bool buildCompactBVH(float edgeLengthThreshold, const VertexGrid* grid, int nThreads = 1);
     
-    const BVH* bvh() const { return bvh_.get(); }
+    const MeshBVH* bvh() const { return bvh_.get(); }
+    void setBVH(std::unique_ptr<MeshBVH> bvh) { bvh_ = std::move(bvh); }
     
     private:
-    std::unique_ptr<BVH> bvh_;
-    std::vector<Object*> objects_;
+    size_t appendTriangles(std::vector<Triangle>& triangles, float edgeLengthThreshold) const;
+    
+    std::unique_ptr<MeshBVH> bvh_;
     
     std::string name_;
     uint32_t label_;
@@ -0,0 +1,244 @@
+#include "MeshBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "TraversalStats.h"
+
+static const uint32_t maxStackSize = bvhMaxStackSize;
+
+MeshBVH::MeshBVH(std::vector<Triangle> triangles, uint32_t leafSize, int nThreads)
+{
+    if(triangles.empty()) {
+        return;
+    }
+
+    std::vector<BVHBuildPrim> prims(triangles.size());
+    for(size_t i=0; i<triangles.size(); ++i) {
+        prims[i].bbox = triangles[i].getBBox();
+        prims[i].centroid = triangles[i].getCentroid();
+        prims[i].index = i;
+    }
+
+    nodes_ = buildBVHNodes(prims, leafSize, nThreads);
+
+    // the build has sorted the primitives into leaf order
+    triangles_ = TriangleStore(triangles.size());
+    for(size_t i=0; i<prims.size(); ++i) {
+        const Triangle& t = triangles[prims[i].index];
+        triangles_.set(i, t.v1, t.v2, t.v3);
+    }
+}
+
+MeshBVH::MeshBVH(TriangleStore triangles, uint32_t leafSize, int nThreads)
+{
+    if(triangles.size() == 0) {
+        return;
+    }
+
+    // the bounding boxes and centroids of the corners, exactly as for
+    // the expanded triangles, so that both give the same tree
+    const uint32_t* indices = triangles.indices();
+    std::vector<BVHBuildPrim> prims(triangles.size());
+    for(size_t i=0; i<prims.size(); ++i) {
+        const Vector3 v1 = triangles.vertex(indices[3*i]);
+        const Vector3 v2 = triangles.vertex(indices[3*i+1]);
+        const Vector3 v3 = triangles.vertex(indices[3*i+2]);
+        prims[i].bbox = BBox(min(v1, min(v2,v3)), max(v1, max(v2,v3)));
+        prims[i].centroid = 1.0f/3.0f * (v1+v2+v3);
+        prims[i].index = i;
+    }
+
+    nodes_ = buildBVHNodes(prims, leafSize, nThreads);
+
+    std::vector<uint32_t> leafOrder(3*prims.size());
+    for(size_t i=0; i<prims.size(); ++i) {
+        std::copy(&indices[3*prims[i].index], &indices[3*prims[i].index] + 3, &leafOrder[3*i]);
+    }
+    triangles_ = std::move(triangles);
+    triangles_.setIndices(std::move(leafOrder));
+}
+
+MeshBVH::MeshBVH(std::vector<MeshBVHNode> nodes, TriangleStore triangles)
+    : triangles_(std::move(triangles)), nodes_(std::move(nodes))
+{
+}
+
+uint32_t MeshBVH::nLeaves() const
+{
+    uint32_t n = 0;
+    for(const MeshBVHNode& node : nodes_) {
+        n += node.rightOffset == 0;
+    }
+    return n;
+}
+
+void MeshBVH::getAllIntersections(const Ray& ray, std::vector<RayHit>& hits) const
+{
+    hits.clear();
+    if(nodes_.empty()) {
+        return;
+    }
+
+    TraversalCounters counted;
+    TRAVERSAL_COUNT(counted.rays, 1);
+
+    uint32_t todo[maxStackSize];
+    int32_t stackptr = 0;
+    todo[stackptr] = 0;
+
+    while(stackptr >= 0) {
+        const uint32_t ni = todo[stackptr];
+        --stackptr;
+        const MeshBVHNode& node = nodes_[ni];
+        TRAVERSAL_COUNT(counted.nodes, 1);
+
+        float tnear, tfar;
+        if(!node.bbox.intersect(ray, &tnear, &tfar)) {
+            continue;
+        }
+
+        if(node.rightOffset == 0) {
+            TRAVERSAL_COUNT(counted.triangleTests, node.nPrims);
+            for(uint32_t o = node.start; o < node.start + node.nPrims; ++o) {
+                float t;
+                if(triangles_.intersect(o, ray, &t)) {
+                    RayHit h;
+                    h.t = t;
+                    h.prim = o;
+                    hits.push_back(h);
+                }
+            }
+        }
+        else {
+            todo[++stackptr] = ni + node.rightOffset;
+            todo[++stackptr] = ni + 1;
+        }
+    }
+
+    const size_t nFound = hits.size();
+    TRAVERSAL_COUNT(counted.hits, nFound);
+    sortAndMergeHits(hits);
+    TRAVERSAL_COUNT(counted.mergedHits, nFound - hits.size());
+    TRAVERSAL_ADD(counted);
+}
+
+void MeshBVH::getAllIntersections4(const AxisRayPacket4& packet, std::vector<RayHit>* hits) const
+{
+    for(int i=0; i<4; ++i) {
+        hits[i].clear();
+    }
+    if(nodes_.empty() || packet.nRays <= 0) {
+        return;
+    }
+
+    const int axis = packet.axis;
+    const int uAxis = axis == 0 ? 1 : 0;
+    const int vAxis = axis == 2 ? 1 : 2;
+
+    float u[4], v[4];
+    for(int i=0; i<4; ++i) {
+        // unused lanes repeat the last ray and are masked out below
+        u[i] = packet.u[std::min(i, packet.nRays-1)];
+        v[i] = packet.v[std::min(i, packet.nRays-1)];
+    }
+    const __m128 U = _mm_loadu_ps(u);
+    const __m128 V = _mm_loadu_ps(v);
+    __m128 O[3];
+    O[axis]  = _mm_set1_ps(packet.start);
+    O[uAxis] = U;
+    O[vAxis] = V;
+    const Vector3 D(axis == 0, axis == 1, axis == 2);
+
+    struct Entry {
+        uint32_t node;
+        int mask;
+    };
+    Entry todo[maxStackSize];
+    int32_t stackptr = 0;
+    todo[stackptr].node = 0;
+    todo[stackptr].mask = (1 << std::min(packet.nRays, 4)) - 1;
+
+    // a node visit and a triangle test count once per active ray, as
+    // they would when tracing the rays one by one
+    TraversalCounters counted;
+    TRAVERSAL_COUNT(counted.rays, std::min(packet.nRays, 4));
+
+    while(stackptr >= 0) {
+        const uint32_t ni = todo[stackptr].node;
+        int mask = todo[stackptr].mask;
+        --stackptr;
+        const MeshBVHNode& node = nodes_[ni];
+        TRAVERSAL_COUNT(counted.nodes, __builtin_popcount(mask));
+
+        // An axis aligned ray passes through a box iff its two fixed
+        // coordinates lie within the box and the box is not behind it.
+        if(node.bbox.max[axis] < packet.start) {
+            continue;
+        }
+        const __m128 inside = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(U, _mm_set1_ps(node.bbox.min[uAxis])),
+                       _mm_cmple_ps(U, _mm_set1_ps(node.bbox.max[uAxis]))),
+            _mm_and_ps(_mm_cmpge_ps(V, _mm_set1_ps(node.bbox.min[vAxis])),
+                       _mm_cmple_ps(V, _mm_set1_ps(node.bbox.max[vAxis]))));
+        mask &= _mm_movemask_ps(inside);
+        if(mask == 0) {
+            continue;
+        }
+
+        if(node.rightOffset == 0) {
+            TRAVERSAL_COUNT(counted.triangleTests, node.nPrims * __builtin_popcount(mask));
+            for(uint32_t o = node.start; o < node.start + node.nPrims; ++o) {
+                __m128 t;
+                const int hitMask = mask & triangles_.intersect4(o, O, D, &t);
+                if(hitMask == 0) {
+                    continue;
+                }
+                float ts[4];
+                _mm_storeu_ps(ts, t);
+                for(int i=0; i<4; ++i) {
+                    if(hitMask & (1 << i)) {
+                        RayHit h;
+                        h.t = ts[i];
+                        h.prim = o;
+                        hits[i].push_back(h);
+                    }
+                }
+            }
+        }
+        else {
+            ++stackptr;
+            todo[stackptr].node = ni + node.rightOffset;
+            todo[stackptr].mask = mask;
+            ++stackptr;
+            todo[stackptr].node = ni + 1;
+            todo[stackptr].mask = mask;
+        }
+    }
+
+    for(int i=0; i<packet.nRays; ++i) {
+        const size_t nFound = hits[i].size();
+        TRAVERSAL_COUNT(counted.hits, nFound);
+        sortAndMergeHits(hits[i]);
+        TRAVERSAL_COUNT(counted.mergedHits, nFound - hits[i].size());
+    }
+    TRAVERSAL_ADD(counted);
+}
+
+void MeshBVH::sortAndMergeHits(std::vector<RayHit>& hits)
+{
+    std::sort(hits.begin(), hits.end());
+
+    // Merge hits which coincide up to float precision, these stem from
+    // rays through shared edges or vertices.
+    const float eps = 8*std::numeric_limits<float>::epsilon();
+    size_t n = 0;
+    for(size_t i = 0; i < hits.size(); ++i) {
+        if(n > 0 && hits[i].t - hits[n-1].t <= eps * std::max(1.0f, std::abs(hits[i].t))) {
+            continue;
+        }
+        hits[n++] = hits[i];
+    }
+    hits.resize(n);
+}
@@ -0,0 +1,108 @@
+#ifndef MESHBVH_H
+#define MESHBVH_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "fastbvh/BBox.h"
+#include "fastbvh/Ray.h"
+#include "fastbvh/Vector3.h"
+
+#include "BVHBuilder.h"
+#include "Triangle.h"
+#include "TriangleStore.h"
+
+/**
+ * A single intersection of a ray with a triangle of a MeshBVH.
+ * prim indexes MeshBVH::triangles().
+ */
+struct RayHit {
+    float t;
+    uint32_t prim;
+
+    bool operator<(const RayHit& other) const { return t < other.t; }
+};
+
+/**
+ * Up to four rays running along the positive direction of the same
+ * coordinate axis, which are traced together by
+ * MeshBVH::getAllIntersections4.
+ * All rays start at coordinate start along axis; u and v hold their
+ * coordinates along the two other axes (in increasing axis order).
+ */
+struct AxisRayPacket4 {
+    int axis;
+    int nRays;
+    float start;
+    float u[4];
+    float v[4];
+};
+
+/**
+ * Bounding volume hierarchy over the triangles of a single mesh.
+ *
+ * Unlike Fast-BVH's BVH, which only returns the closest hit, this tree
+ * can report all intersections along a ray in a single traversal.
+ * It owns its triangles and stores them in leaf order in a
+ * TriangleStore, so that the leaves index it directly.
+ */
+class MeshBVH {
+    public:
+    /**
+     * Builds the tree. triangles is only needed during the build, the
+     * tree keeps a compact copy of the geometry.
+     * Nodes are split with the binned surface area heuristic; subtrees of
+     * large meshes are built on up to nThreads threads.
+     */
+    MeshBVH(std::vector<Triangle> triangles, uint32_t leafSize = 4, int nThreads = 1);
+
+    /**
+     * Builds the tree over the triangles of a compact TriangleStore
+     * (see TriangleStore::Layout), which it keeps with the triangles
+     * reordered into leaf order.
+     */
+    MeshBVH(TriangleStore triangles, uint32_t leafSize = 4, int nThreads = 1);
+
+    /**
+     * Creates a tree from the nodes and triangles of a previously built
+     * one (see SceneCache).
+     */
+    MeshBVH(std::vector<MeshBVHNode> nodes, TriangleStore triangles);
+
+    /**
+     * Collects all intersections of ray with the mesh into hits (which is
+     * cleared first), sorted by increasing t.
+     * Hits closer to each other than what float precision can resolve
+     * (e.g. a ray passing exactly through an edge shared by two triangles)
+     * are reported only once.
+     * hits is meant to be reused between calls to avoid allocations.
+     */
+    void getAllIntersections(const Ray& ray, std::vector<RayHit>& hits) const;
+
+    /**
+     * Same as getAllIntersections, for all rays of packet at once.
+     * hits[i] receives the intersections of the i-th ray.
+     * The tree is walked once per packet: a node is visited if any of the
+     * rays passes through it, and each triangle is tested against all rays
+     * with SSE (see triangle_intersection4).
+     */
+    void getAllIntersections4(const AxisRayPacket4& packet, std::vector<RayHit>* hits) const;
+
+    const TriangleStore& triangles() const { return triangles_; }
+    const std::vector<MeshBVHNode>& nodes() const { return nodes_; }
+
+    uint32_t nLeaves() const;
+
+    /**
+     * Sorts hits by t and merges those closer to each other than what
+     * float precision can resolve, as getAllIntersections does.
+     */
+    static void sortAndMergeHits(std::vector<RayHit>& hits);
+
+    private:
+
+    TriangleStore triangles_;
+    std::vector<MeshBVHNode> nodes_;
+};
+
+#endif /* MESHBVH_H */
@@ -1,128 +1,380 @@
 #include "OBJReader.h"
 
-#include <fstream>
 #include <sstream>
-#include <boost/algorithm/string.hpp>
 #include <iostream>
+#include <iterator>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
+#include <exception>
+#include <stdexcept>
+
+#include "MappedFile.h"
+#include "Parallel.h"
 
 OBJReader::OBJReader(const std::string& filename)
-    : filename_(filename), maxObjects_(-1) {}
+    : filename_(filename), maxObjects_(-1), nThreads_(1), useBounds_(false) {}
+
+// Number parsing
+//
+// The OBJ parser used to split every line into std::strings and convert
+// them with std::stof/std::stoi. The functions below parse a token
+// [b, e) in place, with exactly the same results and exceptions.
+// Only the common cases are handled here, everything else (and the rare
+// cases where the fast path could round differently) is passed on to
+// strtof/strtol.
+
+static const char* copyToken(const char* b, const char* e, char* buf, size_t bufSize, std::string& tmp)
+{
+    const size_t n = e - b;
+    if(n < bufSize) {
+        std::memcpy(buf, b, n);
+        buf[n] = 0;
+        return buf;
+    }
+    tmp.assign(b, e);
+    return tmp.c_str();
+}
+
+static float parseFloatSlow(const char* b, const char* e)
+{
+    char buf[64];
+    std::string tmp;
+    const char* s = copyToken(b, e, buf, sizeof(buf), tmp);
+    char* end;
+    errno = 0;
+    const float f = std::strtof(s, &end);
+    if(end == s) {
+        throw std::invalid_argument("stof");
+    }
+    if(errno == ERANGE) {
+        throw std::out_of_range("stof");
+    }
+    return f;
+}
+
+static float parseFloat(const char* b, const char* e)
+{
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* p = b;
+    bool negative = false;
+    if(p < e && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any = false;
+    for(; p < e && *p >= '0' && *p <= '9'; ++p) {
+        mantissa = 10*mantissa + (*p - '0');
+        digits += mantissa > 0;
+        any = true;
+    }
+    if(p < e && *p == '.') {
+        for(++p; p < e && *p >= '0' && *p <= '9'; ++p) {
+            mantissa = 10*mantissa + (*p - '0');
+            digits += mantissa > 0;
+            --exponent;
+            any = true;
+        }
+    }
+    if(!any || digits > 19 || (p < e && (*p == 'e' || *p == 'E'))
+       || mantissa > (uint64_t(1) << 53) || exponent < -22)
+    {
+        return parseFloatSlow(b, e);
+    }
+
+    // Both mantissa and 10^-exponent are exact doubles, so the division
+    // is correctly rounded. Rounding that once more to float gives the
+    // correctly rounded float unless the double lies exactly halfway
+    // between two floats.
+    const double d = double(mantissa) / pow10[-exponent];
+    uint64_t bits;
+    std::memcpy(&bits, &d, sizeof(bits));
+    if((bits & ((uint64_t(1) << 29) - 1)) == (uint64_t(1) << 28)) {
+        return parseFloatSlow(b, e);
+    }
+    const float f = static_cast<float>(d);
+    return negative ? -f : f;
+}
+
+static int parseIntSlow(const char* b, const char* e)
+{
+    char buf[64];
+    std::string tmp;
+    const char* s = copyToken(b, e, buf, sizeof(buf), tmp);
+    char* end;
+    errno = 0;
+    const long l = std::strtol(s, &end, 10);
+    if(end == s) {
+        throw std::invalid_argument("stoi");
+    }
+    if(errno == ERANGE || l < INT_MIN || l > INT_MAX) {
+        throw std::out_of_range("stoi");
+    }
+    return static_cast<int>(l);
+}
+
+static int parseInt(const char* b, const char* e)
+{
+    const char* p = b;
+    bool negative = false;
+    if(p < e && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    const char* digitsBegin = p;
+    int64_t value = 0;
+    for(; p < e && *p >= '0' && *p <= '9' && p - digitsBegin < 10; ++p) {
+        value = 10*value + (*p - '0');
+    }
+    if(p == digitsBegin || (p < e && *p >= '0' && *p <= '9') || value > INT_MAX) {
+        return parseIntSlow(b, e);
+    }
+    return static_cast<int>(negative ? -value : value);
+}
+
+// Splits [b, e) at every ' ', like boost::split(toks, line, is_any_of(" ")).
+// Stores the first maxToks tokens and returns the total number of tokens.
+static size_t splitTokens(const char* b, const char* e,
+                          const char** toks, const char** tokEnds, size_t maxToks)
+{
+    size_t n = 0;
+    for(;;) {
+        const char* s = static_cast<const char*>(std::memchr(b, ' ', e - b));
+        if(!s) {
+            s = e;
+        }
+        if(n < maxToks) {
+            toks[n] = b;
+            tokEnds[n] = s;
+        }
+        ++n;
+        if(s == e) {
+            return n;
+        }
+        b = s + 1;
+    }
+}
+
+static const char* endOfLine(const char* p, const char* end)
+{
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return eol ? eol : end;
+}
+
+// A part of the file which describes a single object
+struct OBJReader::ObjectRange {
+    const char* begin;
+    const char* end;
+    size_t firstLine;
+    uint32_t vertexOffset;
+    size_t nVertices;
+    size_t nFaces;
+    std::string messages;
+};
 
 void OBJReader::read(Scene& scene) const
 {
+    MappedFile file(filename_);
+    const char* p = file.data();
+    const char* const end = p + file.size();
+
+    // First pass: find where each object starts and ends, count its
+    // vertices and check all lines which do not need to be parsed.
+    // This has to be done serially, as the vertex indices of the
+    // faces are relative to the start of the file.
+
+    std::vector<ObjectRange> objects;
+    std::exception_ptr error;
     uint32_t vertexOffset = 1;
-    
-    std::ifstream f(filename_);
-    std::string line;
-    
-    uint32_t currentLabel = 0;
-   
-    std::vector<std::string> toks;
-    Mesh* m = 0;
     size_t lineNo = 0;
-    while (std::getline(f, line)) {
+
+    while(p < end) {
+        const char* eol = endOfLine(p, end);
+        const char* next = eol < end ? eol+1 : end;
+        const size_t len = eol - p;
         ++lineNo;
-        if(line.size() == 0) continue;
-        if(line[1] == ' ') {
-            char c = line[0];
+        if(len == 0) {
+            p = next;
+            continue;
+        }
+        if(len >= 2 && p[1] == ' ') {
+            char c = p[0];
             if(c == '#') {
             }
             else if(c == 'o') {
-                //if(scene.meshes.size() > 0) {
-                //    break;
-                //}
-                line = line.substr(2,line.size());
-                //if(objs.find(line) != objs.end()) {
-                //    throw std::runtime_error("duplicate object");
-                //}
-               
-                if(maxObjects_ >= 0 && currentLabel == maxObjects_) {
+                if(maxObjects_ >= 0 && objects.size() == static_cast<size_t>(maxObjects_)) {
                     break;
                 }
-                
-                std::cout << "  " << currentLabel+1 << " : " << line << std::endl;
-                
-                if(m) {
-                    vertexOffset += m->vertices.size();
+
+                const std::string name(p+2, eol);
+
+                if(!objects.empty()) {
+                    objects.back().end = p;
+                    vertexOffset += objects.back().nVertices;
                 }
+                ObjectRange o;
+                o.begin = next;
+                o.end = end;
+                o.firstLine = lineNo+1;
+                o.vertexOffset = vertexOffset;
+                o.nVertices = 0;
+                o.nFaces = 0;
+                objects.push_back(o);
+                std::stringstream ss;
+                ss << "  " << objects.size() << " : " << name << std::endl;
+                objects.back().messages = ss.str();
+
                 scene.meshes.push_back( Mesh() );
-                m = &scene.meshes.back();
-                m->setName(line);
-                m->setLabel(++currentLabel);
-            }
-            else if(c == 'v') {
-                if( m == 0 ) { throw std::runtime_error("m == 0"); }
-                
-                toks.clear();
-                line = line.substr(2, line.size());
-                boost::split(toks, line, boost::is_any_of(" "));
-                if(toks.size() != 3) {
-                    std::stringstream ss;
-                    ss << "vertices: unexpected number of tokens" << std::endl;
-                    ss << "line: " << line << std::endl;
-                    throw std::runtime_error(ss.str());
-                }
-                Vector3 f;
-                std::transform(toks.begin(), toks.end(), &f[0], [](const std::string& s) { return std::stof(s); });
-                m->vertices.push_back(f);
+                scene.meshes.back().setName(name);
+                scene.meshes.back().setLabel(objects.size());
             }
-            else if(c == 'f') {
-                if( m == 0 ) { throw std::runtime_error("m == 0"); }
-                toks.clear();
-                line = line.substr(2, line.size());
-                boost::split(toks, line, boost::is_any_of(" "));
-                
-                if(toks.size() == 4) {
-                    std::array<uint32_t, 4> f;
-                    std::transform(toks.begin(), toks.end(), f.begin(), [vertexOffset](const std::string& s) { return std::stoi(s)-vertexOffset; });
-                    for(int i=0; i<4; ++i) {
-                        if(f[i] >= m->vertices.size()) {
-                            std::stringstream ss;
-                            ss << "object '" << m->name() << "' has " << m->vertices.size() << " vertices, but read face = ";
-                            std::copy(f.begin(), f.end(), std::ostream_iterator<uint32_t>(ss, " "));
-                            ss << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
-                    }
-                    m->faces.push_back({f[0], f[1], f[3]});
-                    m->faces.push_back({f[3], f[1], f[2]});
-                }
-                else if(toks.size() == 3) {
-                    std::array<uint32_t, 3> f;
-                    std::transform(toks.begin(), toks.end(), f.begin(), [vertexOffset](const std::string& s) { return std::stoi(s)-vertexOffset; });
-                    for(int i=0; i<3; ++i) {
-                        if(f[i] >= m->vertices.size()) {
-                            std::stringstream ss;
-                            ss << "object '" << m->name() << "' has " << m->vertices.size() << " vertices, but read face = ";
-                            std::copy(f.begin(), f.end(), std::ostream_iterator<uint32_t>(ss, " "));
-                            ss << std::endl;
-                            throw std::runtime_error(ss.str());
-                        }
-                    }
-                    m->faces.push_back(f);
-                }
-                else {
-                    std::stringstream ss;
-                    ss << "WARNING: line " << lineNo << ": faces: unexpected number of tokens: " << toks.size();
-                    std::cerr << ss.str() << std::endl;
+            else if(c == 'v' || c == 'f') {
+                if(objects.empty()) {
+                    error = std::make_exception_ptr(std::runtime_error("m == 0"));
+                    break;
                 }
+                ++(c == 'v' ? objects.back().nVertices : objects.back().nFaces);
             }
             else if(c == 's') {
             }
             else if(c == 'l') {
             }
+            else if(objects.empty()) {
+                std::cout << std::string(p, eol) << std::endl;
+            }
             else {
-                std::cout << line << std::endl;
+                objects.back().messages += std::string(p, eol) + "\n";
             }
         }
-        else if(line.substr(0,6) == std::string("usemtl")) {
+        else if(len >= 6 && std::strncmp(p, "usemtl", 6) == 0) {
         }
-        else if(line.substr(0,6) == std::string("mtllib")) {
+        else if(len >= 6 && std::strncmp(p, "mtllib", 6) == 0) {
         }
         else {
             std::stringstream ss;
-            ss << "unexpected line: " << line << std::endl;
-            throw std::runtime_error(ss.str());
+            ss << "unexpected line: " << std::string(p, eol) << std::endl;
+            error = std::make_exception_ptr(std::runtime_error(ss.str()));
+            break;
+        }
+        p = next;
+    }
+    if(!objects.empty()) {
+        // the last object ends where reading stopped
+        objects.back().end = p;
+    }
+
+    // Second pass: parse the vertices and faces of all objects in parallel.
+    // Messages, warnings and errors are reported afterwards, in the order
+    // in which they appear in the file.
+
+    const size_t firstMesh = scene.meshes.size() - objects.size();
+    std::vector<std::exception_ptr> errors(objects.size());
+    std::vector<std::string> warnings(objects.size());
+
+    parallelFor(objects.size(), nThreads_, [&](size_t i, int) {
+        std::stringstream w;
+        try {
+            parseObject(objects[i], scene.meshes[firstMesh+i], w);
+        }
+        catch(...) {
+            errors[i] = std::current_exception();
+        }
+        warnings[i] = w.str();
+    });
+
+    for(size_t i=0; i<objects.size(); ++i) {
+        std::cout << objects[i].messages << std::flush;
+        std::cerr << warnings[i];
+        if(errors[i]) {
+            scene.meshes.resize(firstMesh+i+1);
+            std::rethrow_exception(errors[i]);
+        }
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void OBJReader::parseObject(const ObjectRange& o, Mesh& mesh, std::ostream& warnings) const
+{
+    Mesh* m = &mesh;
+    m->vertices.reserve(o.nVertices);
+    m->faces.reserve(o.nFaces);
+
+    const uint32_t vertexOffset = o.vertexOffset;
+    const char* toks[4];
+    const char* tokEnds[4];
+    size_t lineNo = o.firstLine;
+
+    for(const char* p = o.begin; p < o.end; ++lineNo) {
+        const char* eol = endOfLine(p, o.end);
+        const char* line = p;
+        p = eol < o.end ? eol+1 : o.end;
+
+        if(eol - line < 2 || line[1] != ' ') {
+            continue;
+        }
+        const char c = line[0];
+        if(c == 'v') {
+            const size_t n = splitTokens(line+2, eol, toks, tokEnds, 4);
+            if(n != 3) {
+                std::stringstream ss;
+                ss << "vertices: unexpected number of tokens" << std::endl;
+                ss << "line: " << std::string(line+2, eol) << std::endl;
+                throw std::runtime_error(ss.str());
+            }
+            Vector3 f;
+            for(int i=0; i<3; ++i) {
+                f[i] = parseFloat(toks[i], tokEnds[i]);
+            }
+            m->vertices.push_back(f);
+        }
+        else if(c == 'f') {
+            const size_t n = splitTokens(line+2, eol, toks, tokEnds, 4);
+            if(n == 3 || n == 4) {
+                std::array<uint32_t, 4> f;
+                for(size_t i=0; i<n; ++i) {
+                    f[i] = static_cast<uint32_t>(parseInt(toks[i], tokEnds[i])) - vertexOffset;
+                }
+                for(size_t i=0; i<n; ++i) {
+                    if(f[i] >= m->vertices.size()) {
+                        std::stringstream ss;
+                        ss << "object '" << m->name() << "' has " << m->vertices.size() << " vertices, but read face = ";
+                        std::copy(f.begin(), f.begin()+n, std::ostream_iterator<uint32_t>(ss, " "));
+                        ss << std::endl;
+                        throw std::runtime_error(ss.str());
+                    }
+                }
+                if(n == 4) {
+                    m->faces.push_back({f[0], f[1], f[3]});
+                    m->faces.push_back({f[3], f[1], f[2]});
+                }
+                else {
+                    m->faces.push_back({f[0], f[1], f[2]});
+                }
+            }
+            else {
+                warnings << "WARNING: line " << lineNo << ": faces: unexpected number of tokens: " << n << std::endl;
+            }
+        }
+    }
+
+    if(useBounds_ && !m->vertices.empty()) {
+        const BBox b = m->bbox();
+        for(int i=0; i<3; ++i) {
+            if(b.max[i] < bounds_.min[i] || b.min[i] > bounds_.max[i]) {
+                std::vector<Vector3>().swap(m->vertices);
+                std::vector<Mesh::Tri>().swap(m->faces);
+                break;
+            }
         }
     }
 }
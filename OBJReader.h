@@ -2,20 +2,44 @@
 #define OBJ_READER
 
 #include <string>
+#include <ostream>
 
 #include "Scene.h"
 
+/**
+ * Reads all objects ('o' lines) of a Wavefront .obj file as separate
+ * meshes, labeled 1, 2, ... in the order of the file.
+ *
+ * The file is memory mapped. A quick serial pass finds the objects,
+ * their vertices and faces are then parsed in parallel.
+ */
 class OBJReader {
     public:
     OBJReader(const std::string& filename);
-    
+
     void setMaxObjects(int maxObjects) { maxObjects_ = maxObjects; }
-    
+
+    void setNumThreads(int nThreads) { nThreads_ = nThreads; }
+
+    /**
+     * Objects whose bounding box does not intersect bounds are still
+     * read (with their name and label), but their vertices and faces
+     * are dropped right after parsing.
+     */
+    void setBounds(const BBox& bounds) { bounds_ = bounds; useBounds_ = true; }
+
     void read(Scene& scene) const;
-    
+
     private:
+    struct ObjectRange;
+
+    void parseObject(const ObjectRange& o, Mesh& mesh, std::ostream& warnings) const;
+
     std::string filename_;
     int maxObjects_;
+    int nThreads_;
+    BBox bounds_;
+    bool useBounds_;
 };
 
-#endif /* OBJ_READER */
\ No newline at end of file
+#endif /* OBJ_READER */
@@ -0,0 +1,150 @@
+#include "OutputManifest.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+static const char* const header = "surface2volume manifest 1";
+
+// FNV-1a
+static void hashBytes(uint64_t& h, const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for(size_t i=0; i<size; ++i) {
+        h = (h ^ p[i]) * 1099511628211ull;
+    }
+}
+
+uint64_t OutputManifest::hashMesh(const Mesh& mesh)
+{
+    uint64_t h = 14695981039346656037ull;
+    const uint64_t n[2] = {mesh.vertices.size(), mesh.faces.size()};
+    hashBytes(h, n, sizeof(n));
+    for(const Vector3& v : mesh.vertices) {
+        const float f[3] = {v[0], v[1], v[2]};
+        hashBytes(h, f, sizeof(f));
+    }
+    hashBytes(h, mesh.faces.data(), mesh.faces.size()*sizeof(Mesh::Tri));
+    return h;
+}
+
+bool OutputManifest::read(const std::string& filename)
+{
+    std::ifstream in(filename.c_str());
+    std::string line;
+    if(!std::getline(in, line) || line != header) {
+        return false;
+    }
+    std::string key;
+    size_t n = 0;
+    if(!(in >> key) || key != "settings" || !std::getline(in, settings)
+       || !(in >> key >> n) || key != "objects")
+    {
+        return false;
+    }
+    if(!settings.empty() && settings[0] == ' ') {
+        settings.erase(0, 1);
+    }
+    objects.resize(n);
+    for(Object& o : objects) {
+        in >> std::hex >> o.hash >> std::dec;
+        for(int i=0; i<3; ++i) {
+            in >> o.begin[i];
+        }
+        for(int i=0; i<3; ++i) {
+            in >> o.end[i];
+        }
+    }
+    return bool(in);
+}
+
+void OutputManifest::write(const std::string& filename) const
+{
+    // write to a temporary file first, so that an interrupted run
+    // never leaves a truncated manifest behind
+    const std::string tmpFile = filename + ".tmp";
+    std::ofstream o(tmpFile.c_str());
+    o << header << "\n";
+    o << "settings " << settings << "\n";
+    o << "objects " << objects.size() << "\n";
+    for(const Object& obj : objects) {
+        o << std::hex << obj.hash << std::dec;
+        for(int i=0; i<3; ++i) {
+            o << " " << obj.begin[i];
+        }
+        for(int i=0; i<3; ++i) {
+            o << " " << obj.end[i];
+        }
+        o << "\n";
+    }
+    o.close();
+    if(!o || std::rename(tmpFile.c_str(), filename.c_str()) != 0) {
+        std::remove(tmpFile.c_str());
+        throw std::runtime_error("could not write '" + filename + "'");
+    }
+}
+
+static bool overlap(const OutputManifest::Region& a, const OutputManifest::Region& b)
+{
+    for(int i=0; i<3; ++i) {
+        if(a.second[i] <= b.first[i] || b.second[i] <= a.first[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<OutputManifest::Region> OutputManifest::changedRegions(const OutputManifest& previous,
+                                                                   const vigra::Shape3& shape,
+                                                                   const vigra::Shape3& chunkShape) const
+{
+    std::vector<Region> regions;
+    auto add = [&](const Object& o) {
+        Region r;
+        for(int i=0; i<3; ++i) {
+            if(o.begin[i] >= o.end[i]) {
+                return;
+            }
+            r.first[i] = o.begin[i] / chunkShape[i] * chunkShape[i];
+            r.second[i] = std::min((o.end[i] + chunkShape[i] - 1) / chunkShape[i] * chunkShape[i], shape[i]);
+        }
+        regions.push_back(r);
+    };
+    const size_t n = std::max(objects.size(), previous.objects.size());
+    for(size_t i=0; i<n; ++i) {
+        const Object* before = i < previous.objects.size() ? &previous.objects[i] : 0;
+        const Object* after = i < objects.size() ? &objects[i] : 0;
+        if(before && after && before->hash == after->hash) {
+            continue;
+        }
+        if(before) {
+            add(*before);
+        }
+        if(after) {
+            add(*after);
+        }
+    }
+
+    // merge overlapping regions into their bounding box until none overlap
+    for(bool merged = true; merged; ) {
+        merged = false;
+        for(size_t i=0; i<regions.size(); ++i) {
+            for(size_t j=i+1; j<regions.size(); ++j) {
+                if(!overlap(regions[i], regions[j])) {
+                    continue;
+                }
+                for(int k=0; k<3; ++k) {
+                    regions[i].first[k] = std::min(regions[i].first[k], regions[j].first[k]);
+                    regions[i].second[k] = std::max(regions[i].second[k], regions[j].second[k]);
+                }
+                regions.erase(regions.begin() + j);
+                merged = true;
+                --j;
+            }
+        }
+    }
+    return regions;
+}
@@ -0,0 +1,59 @@
+#ifndef OUTPUTMANIFEST_H
+#define OUTPUTMANIFEST_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+#include <vigra/multi_shape.hxx>
+
+#include "Mesh.h"
+
+/**
+ * What an output volume was rendered from: the settings which affect it,
+ * and a content hash and the affected region (see
+ * Voxelizer::affectedRegion) of every object, in label order.
+ *
+ * Stored next to the output, it lets a later run find the objects which
+ * were added, removed or changed since, and re-voxelize only the regions
+ * they affect (see changedRegions()).
+ */
+class OutputManifest {
+    public:
+    struct Object {
+        uint64_t hash;
+        // affected voxels [begin, end) in vigra order, empty if begin == end
+        vigra::Shape3 begin;
+        vigra::Shape3 end;
+    };
+
+    typedef std::pair<vigra::Shape3, vigra::Shape3> Region;
+
+    /** Output settings (scene box, shape, chunks, codec, ...), compared as a whole. */
+    std::string settings;
+    std::vector<Object> objects;
+
+    /** Hash of the vertices and faces of mesh. */
+    static uint64_t hashMesh(const Mesh& mesh);
+
+    /** Returns false if filename does not exist or is not a manifest. */
+    bool read(const std::string& filename);
+
+    /** Throws std::runtime_error on failure. */
+    void write(const std::string& filename) const;
+
+    /**
+     * Returns the regions whose labels may differ between an output
+     * rendered as described by previous and one rendered as described by
+     * this manifest, which must have the same settings. An object whose
+     * index (i.e. label) or hash changed affects both its previous and
+     * its current region.
+     * The regions are expanded to whole chunks of chunkShape (clipped to
+     * the volume shape) and do not overlap.
+     */
+    std::vector<Region> changedRegions(const OutputManifest& previous, const vigra::Shape3& shape,
+                                       const vigra::Shape3& chunkShape) const;
+};
+
+#endif /* OUTPUTMANIFEST_H */
@@ -0,0 +1,80 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Returns the number of worker threads to use if the user did not
+ * specify one (one per hardware thread, at least one).
+ */
+inline int defaultNumThreads()
+{
+    const unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? static_cast<int>(n) : 1;
+}
+
+/**
+ * Calls f(i, threadIndex) for every i in [0, n) using nThreads worker
+ * threads.
+ *
+ * Work items are handed out dynamically: each worker grabs the next
+ * unprocessed index as soon as it is done with its previous one, so
+ * expensive items (e.g. tiles covering many objects) do not stall the
+ * others. With nThreads <= 1 everything runs on the calling thread,
+ * in order.
+ *
+ * The first exception thrown by f is rethrown on the calling thread after
+ * all workers have stopped.
+ */
+template<class F>
+void parallelFor(size_t n, int nThreads, F f)
+{
+    if(nThreads <= 1 || n <= 1) {
+        for(size_t i=0; i<n; ++i) {
+            f(i, 0);
+        }
+        return;
+    }
+
+    nThreads = static_cast<int>(std::min<size_t>(nThreads, n));
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&](int threadIndex) {
+        size_t i;
+        while((i = next.fetch_add(1)) < n) {
+            try {
+                f(i, threadIndex);
+            }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+                next = n;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(int t=1; t<nThreads; ++t) {
+        threads.push_back(std::thread(worker, t));
+    }
+    worker(0);
+    for(auto& t : threads) {
+        t.join();
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,94 @@
+#include "PointQuery.h"
+
+#include <algorithm>
+#include <limits>
+#include <ostream>
+
+#include "Parallel.h"
+#include "ProgressReporter.h"
+#include "TraversalStats.h"
+
+static std::vector<const MeshBVH*> meshBVHs(const Scene& scene)
+{
+    std::vector<const MeshBVH*> bvhs;
+    for(const Mesh& m : scene.meshes) {
+        bvhs.push_back(m.bvh());
+    }
+    return bvhs;
+}
+
+// Spreads the lower 10 bits of x out to every third bit.
+static uint32_t spreadBits(uint32_t x)
+{
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+PointQuery::PointQuery(const Scene& scene)
+    : sceneBVH_(meshBVHs(scene)), nThreads_(1), progress_(0)
+{
+}
+
+void PointQuery::labels(const float* points, size_t n, uint32_t* labels) const
+{
+    std::ostream nullOut(0);
+    ProgressReporter silent(nullOut);
+    ProgressReporter& progress = progress_ ? *progress_ : silent;
+
+    // Morton codes of the points on a 1024^3 grid over their bounding box
+    float lo[3], hi[3];
+    std::fill(lo, lo + 3, std::numeric_limits<float>::max());
+    std::fill(hi, hi + 3, -std::numeric_limits<float>::max());
+    for(size_t i=0; i<n; ++i) {
+        for(int d=0; d<3; ++d) {
+            lo[d] = std::min(lo[d], points[3*i+d]);
+            hi[d] = std::max(hi[d], points[3*i+d]);
+        }
+    }
+    std::vector<std::pair<uint32_t, size_t> > order(n);
+    parallelFor((n + 4095) / 4096, nThreads_, [&](size_t block, int) {
+        for(size_t i = block*4096; i < std::min(n, (block+1)*4096); ++i) {
+            uint32_t code = 0;
+            for(int d=0; d<3; ++d) {
+                const float extent = hi[d] - lo[d];
+                const uint32_t cell = extent > 0 ? uint32_t((points[3*i+d] - lo[d]) / extent * 1023.0f) : 0;
+                code |= spreadBits(cell) << d;
+            }
+            order[i] = std::make_pair(code, i);
+        }
+    });
+    std::sort(order.begin(), order.end());
+
+    const size_t blockSize = 1024;
+    const size_t nBlocks = (n + blockSize - 1) / blockSize;
+    std::vector<SceneHits> hits(nThreads_);
+    std::vector<std::vector<RayHit> > meshHits(nThreads_);
+    progress.beginPhase("query points", n, "points");
+    parallelFor(nBlocks, nThreads_, [&](size_t block, int threadIndex) {
+        uint64_t nHits = 0;
+        const size_t end = std::min(n, (block+1)*blockSize);
+        TRAVERSAL_TARGET(0, 2);
+        for(size_t k = block*blockSize; k < end; ++k) {
+            const size_t i = order[k].second;
+            const Ray ray(Vector3(points[3*i], points[3*i+1], points[3*i+2]), Vector3(0, 0, 1));
+            SceneHits& h = hits[threadIndex];
+            sceneBVH_.getAllIntersections(ray, h, meshHits[threadIndex]);
+            nHits += h.hits.size();
+            // the ranges are sorted by mesh, the last one crossed an odd
+            // number of times contains the point
+            uint32_t label = 0;
+            for(const SceneHitRange& r : h.ranges) {
+                if((r.end - r.begin) % 2 == 1) {
+                    label = r.mesh + 1;
+                }
+            }
+            labels[i] = label;
+        }
+        progress.add(end - block*blockSize, end - block*blockSize, nHits);
+    });
+    progress.endPhase();
+}
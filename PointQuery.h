@@ -0,0 +1,51 @@
+#ifndef POINTQUERY_H
+#define POINTQUERY_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "Scene.h"
+#include "SceneBVH.h"
+
+class ProgressReporter;
+
+/**
+ * Answers which object contains each of a batch of points.
+ *
+ * As in Mesh::contains, a point is inside a mesh if a ray from it along
+ * +z crosses the mesh an odd number of times. All objects are tested
+ * with a single ray per point, traced through a SceneBVH. As in the
+ * volume, the later of overlapping objects wins: a point gets the label
+ * i+1 of the last mesh i containing it, 0 if there is none.
+ *
+ * The points are traced in Morton (Z-curve) order, so that consecutive
+ * rays walk through the same parts of the trees, in blocks handed out
+ * to all threads. The result does not depend on either.
+ */
+class PointQuery {
+    public:
+    /**
+     * Queries the meshes of scene, whose BVHs must have been built (see
+     * Mesh::buildBVH); meshes without one contain no points.
+     * scene must outlive the query.
+     */
+    explicit PointQuery(const Scene& scene);
+
+    void setNumThreads(int nThreads) { nThreads_ = nThreads; }
+
+    /** Reports the query as a phase of progress (may be null). */
+    void setProgress(ProgressReporter* progress) { progress_ = progress; }
+
+    /**
+     * Stores the label of points[3*i], points[3*i+1], points[3*i+2]
+     * (x, y, z) in labels[i], for i in [0, n).
+     */
+    void labels(const float* points, size_t n, uint32_t* labels) const;
+
+    private:
+    SceneBVH sceneBVH_;
+    int nThreads_;
+    ProgressReporter* progress_;
+};
+
+#endif /* POINTQUERY_H */
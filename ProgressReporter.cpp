@@ -0,0 +1,144 @@
+#include "ProgressReporter.h"
+
+#include <iomanip>
+#include <sstream>
+
+ProgressReporter::ProgressReporter(std::ostream& out, double interval)
+    : out_(out), interval_(interval), start_(Clock::now()),
+      current_(0), total_(0), done_(0), rays_(0), hits_(0), nextPrint_(0)
+{
+}
+
+void ProgressReporter::beginPhase(const std::string& name, uint64_t total, const std::string& unit)
+{
+    current_ = phases_.size();
+    for(size_t i=0; i<phases_.size(); ++i) {
+        if(phases_[i].name == name) {
+            current_ = i;
+        }
+    }
+    if(current_ == phases_.size()) {
+        Phase p;
+        p.name = name;
+        p.seconds = 0;
+        p.rays = 0;
+        p.hits = 0;
+        phases_.push_back(p);
+    }
+    phaseStart_ = Clock::now();
+    total_ = total;
+    unit_ = unit;
+    done_ = 0;
+    rays_ = 0;
+    hits_ = 0;
+    nextPrint_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        (phaseStart_ - start_) + std::chrono::duration<double>(interval_)).count();
+}
+
+void ProgressReporter::add(uint64_t done, uint64_t rays, uint64_t hits)
+{
+    done_ += done;
+    rays_ += rays;
+    hits_ += hits;
+
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+    int64_t next = nextPrint_.load();
+    if(now < next) {
+        return;
+    }
+    // only the thread which moves the deadline prints
+    const int64_t step = static_cast<int64_t>(interval_ * 1e9);
+    if(!nextPrint_.compare_exchange_strong(next, now + step)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(printMutex_);
+    print(false);
+}
+
+void ProgressReporter::endPhase()
+{
+    Phase& p = phases_[current_];
+    p.seconds += std::chrono::duration<double>(Clock::now() - phaseStart_).count();
+    p.rays += rays_;
+    p.hits += hits_;
+    std::lock_guard<std::mutex> lock(printMutex_);
+    print(true);
+}
+
+// formats a rate like "12.3 M/s"
+static std::string rate(double n, double seconds)
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1) << (seconds > 0 ? n / seconds / 1e6 : 0.0) << " M";
+    return ss.str();
+}
+
+void ProgressReporter::print(bool final)
+{
+    const double seconds = std::chrono::duration<double>(Clock::now() - phaseStart_).count();
+    const uint64_t done = done_;
+    const uint64_t rays = rays_;
+    const uint64_t hits = hits_;
+
+    std::stringstream ss;
+    ss << "  " << phases_[current_].name << ": " << done;
+    if(total_ > 0) {
+        ss << "/" << total_;
+    }
+    ss << " " << unit_;
+    if(rays > 0) {
+        ss << ", " << rate(rays, seconds) << "rays/s, " << rate(hits, seconds) << "hits/s";
+    }
+    if(final) {
+        ss << ", " << std::fixed << std::setprecision(2) << seconds << " s";
+    }
+    else if(total_ > 0 && done > 0) {
+        ss << ", ETA " << std::fixed << std::setprecision(1) << seconds / done * (total_ - done) << " s";
+    }
+    out_ << ss.str() << "        " << (final ? "\n" : "\r") << std::flush;
+}
+
+double ProgressReporter::seconds(const std::string& prefix) const
+{
+    double seconds = 0;
+    for(const Phase& p : phases_) {
+        if(p.name.compare(0, prefix.size(), prefix) == 0) {
+            seconds += p.seconds;
+        }
+    }
+    return seconds;
+}
+
+void ProgressReporter::summary(std::ostream& out) const
+{
+    double total = 0;
+    for(const Phase& p : phases_) {
+        out << "  " << std::left << std::setw(20) << p.name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << p.seconds << " s";
+        if(p.rays > 0) {
+            out << "  " << rate(p.rays, p.seconds) << "rays/s, " << rate(p.hits, p.seconds) << "hits/s";
+        }
+        out << std::endl;
+        total += p.seconds;
+    }
+    out << "  " << std::left << std::setw(20) << "total" << std::right
+        << std::fixed << std::setprecision(3) << std::setw(10) << total << " s" << std::endl;
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+void ProgressReporter::writeJSON(std::ostream& out, const std::vector<std::pair<std::string, std::string> >& members) const
+{
+    out << "{\n";
+    for(const auto& m : members) {
+        out << "    \"" << m.first << "\": " << m.second << ",\n";
+    }
+    out << "    \"phases\": [\n";
+    for(size_t i=0; i<phases_.size(); ++i) {
+        const Phase& p = phases_[i];
+        out << "        {\"name\": \"" << p.name << "\", \"seconds\": " << p.seconds
+            << ", \"rays\": " << p.rays << ", \"hits\": " << p.hits << "}"
+            << (i+1 < phases_.size() ? "," : "") << "\n";
+    }
+    out << "    ]\n}\n";
+}
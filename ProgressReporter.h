@@ -0,0 +1,80 @@
+#ifndef PROGRESSREPORTER_H
+#define PROGRESSREPORTER_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Thread-safe, throttled progress and metrics reporting for the phases
+ * of a run (parse, BVH build, trace, vote, write).
+ *
+ * Worker threads report finished work with add(), which only touches
+ * atomic counters; at most every interval seconds, one of them prints
+ * a status line with the rates and the estimated time left. Phases
+ * with the same name (e.g. the tracing of each slab) are accumulated.
+ * At the end, summary() or writeJSON() report all phases.
+ */
+class ProgressReporter {
+    public:
+    /** Status lines go to out, at most every interval seconds. */
+    explicit ProgressReporter(std::ostream& out, double interval = 0.5);
+
+    /**
+     * Starts (or continues) the phase name, which consists of total work
+     * units, counted in unit (e.g. "tiles").
+     */
+    void beginPhase(const std::string& name, uint64_t total, const std::string& unit);
+
+    /** Reports done work units, traced rays and ray hits. Thread-safe. */
+    void add(uint64_t done, uint64_t rays = 0, uint64_t hits = 0);
+
+    /** Ends the current phase and finishes its status line. */
+    void endPhase();
+
+    /** The time of all phases whose name starts with prefix. */
+    double seconds(const std::string& prefix) const;
+
+    /** Prints the time, rays/s and hits/s of every phase. */
+    void summary(std::ostream& out) const;
+
+    /**
+     * Writes the phases as JSON, as the "phases" member of an object
+     * which also contains the given (already JSON formatted) members.
+     */
+    void writeJSON(std::ostream& out, const std::vector<std::pair<std::string, std::string> >& members) const;
+
+    private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Phase {
+        std::string name;
+        double seconds;
+        uint64_t rays;
+        uint64_t hits;
+    };
+
+    void print(bool final);
+
+    std::ostream& out_;
+    const double interval_;
+    const Clock::time_point start_;
+
+    std::vector<Phase> phases_;
+    size_t current_;
+    Clock::time_point phaseStart_;
+    uint64_t total_;
+    std::string unit_;
+
+    std::atomic<uint64_t> done_;
+    std::atomic<uint64_t> rays_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<int64_t> nextPrint_;
+    std::mutex printMutex_;
+};
+
+#endif /* PROGRESSREPORTER_H */
@@ -0,0 +1,160 @@
+#include "SceneBVH.h"
+
+#include <algorithm>
+
+#include "TraversalStats.h"
+
+static const uint32_t maxStackSize = bvhMaxStackSize;
+
+SceneBVH::SceneBVH(const std::vector<const MeshBVH*>& meshBVHs)
+{
+    std::vector<BVHBuildPrim> prims;
+    for(size_t i=0; i<meshBVHs.size(); ++i) {
+        const MeshBVH* bvh = meshBVHs[i];
+        if(!bvh || bvh->nodes().empty()) {
+            continue;
+        }
+        BVHBuildPrim p;
+        p.bbox = bvh->nodes()[0].bbox;
+        p.centroid = p.bbox.min + p.bbox.extent * 0.5f;
+        p.index = i;
+        prims.push_back(p);
+    }
+
+    // one mesh per leaf, its BVH takes over from there
+    nodes_ = buildBVHNodes(prims, 1, 1);
+
+    meshIndex_.resize(prims.size());
+    meshBVHs_.resize(prims.size());
+    for(size_t i=0; i<prims.size(); ++i) {
+        meshIndex_[i] = prims[i].index;
+        meshBVHs_[i] = meshBVHs[prims[i].index];
+    }
+}
+
+void SceneBVH::appendMeshHits(uint32_t mesh, const std::vector<RayHit>& meshHits, SceneHits& hits)
+{
+    if(meshHits.empty()) {
+        return;
+    }
+    SceneHitRange r;
+    r.mesh = mesh;
+    r.begin = hits.hits.size();
+    hits.hits.insert(hits.hits.end(), meshHits.begin(), meshHits.end());
+    r.end = hits.hits.size();
+    hits.ranges.push_back(r);
+}
+
+void SceneBVH::sortRanges(SceneHits& hits)
+{
+    std::sort(hits.ranges.begin(), hits.ranges.end(),
+              [](const SceneHitRange& a, const SceneHitRange& b) { return a.mesh < b.mesh; });
+}
+
+void SceneBVH::getAllIntersections(const Ray& ray, SceneHits& hits, std::vector<RayHit>& meshHits) const
+{
+    hits.clear();
+    if(nodes_.empty()) {
+        return;
+    }
+
+    uint32_t todo[maxStackSize];
+    int32_t stackptr = 0;
+    todo[stackptr] = 0;
+
+    while(stackptr >= 0) {
+        const uint32_t ni = todo[stackptr];
+        --stackptr;
+        const MeshBVHNode& node = nodes_[ni];
+
+        float tnear, tfar;
+        if(!node.bbox.intersect(ray, &tnear, &tfar)) {
+            continue;
+        }
+
+        if(node.rightOffset == 0) {
+            for(uint32_t o = node.start; o < node.start + node.nPrims; ++o) {
+                TRAVERSAL_MESH(meshIndex_[o]);
+                meshBVHs_[o]->getAllIntersections(ray, meshHits);
+                appendMeshHits(meshIndex_[o], meshHits, hits);
+            }
+        }
+        else {
+            todo[++stackptr] = ni + node.rightOffset;
+            todo[++stackptr] = ni + 1;
+        }
+    }
+
+    sortRanges(hits);
+}
+
+void SceneBVH::getAllIntersections4(const AxisRayPacket4& packet, SceneHits* hits, std::vector<RayHit>* meshHits) const
+{
+    for(int i=0; i<4; ++i) {
+        hits[i].clear();
+    }
+    if(nodes_.empty() || packet.nRays <= 0) {
+        return;
+    }
+
+    const int axis = packet.axis;
+    const int uAxis = axis == 0 ? 1 : 0;
+    const int vAxis = axis == 2 ? 1 : 2;
+    const int nRays = std::min(packet.nRays, 4);
+
+    struct Entry {
+        uint32_t node;
+        int mask;
+    };
+    Entry todo[maxStackSize];
+    int32_t stackptr = 0;
+    todo[stackptr].node = 0;
+    todo[stackptr].mask = (1 << nRays) - 1;
+
+    while(stackptr >= 0) {
+        const uint32_t ni = todo[stackptr].node;
+        int mask = todo[stackptr].mask;
+        --stackptr;
+        const MeshBVHNode& node = nodes_[ni];
+
+        // same box test as in MeshBVH::getAllIntersections4; there are
+        // few top level nodes, so the lanes are simply tested one by one
+        if(node.bbox.max[axis] < packet.start) {
+            continue;
+        }
+        for(int i=0; i<nRays; ++i) {
+            if(packet.u[i] < node.bbox.min[uAxis] || packet.u[i] > node.bbox.max[uAxis] ||
+               packet.v[i] < node.bbox.min[vAxis] || packet.v[i] > node.bbox.max[vAxis])
+            {
+                mask &= ~(1 << i);
+            }
+        }
+        if(mask == 0) {
+            continue;
+        }
+
+        if(node.rightOffset == 0) {
+            for(uint32_t o = node.start; o < node.start + node.nPrims; ++o) {
+                TRAVERSAL_MESH(meshIndex_[o]);
+                meshBVHs_[o]->getAllIntersections4(packet, meshHits);
+                for(int i=0; i<nRays; ++i) {
+                    if(mask & (1 << i)) {
+                        appendMeshHits(meshIndex_[o], meshHits[i], hits[i]);
+                    }
+                }
+            }
+        }
+        else {
+            ++stackptr;
+            todo[stackptr].node = ni + node.rightOffset;
+            todo[stackptr].mask = mask;
+            ++stackptr;
+            todo[stackptr].node = ni + 1;
+            todo[stackptr].mask = mask;
+        }
+    }
+
+    for(int i=0; i<nRays; ++i) {
+        sortRanges(hits[i]);
+    }
+}
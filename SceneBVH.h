@@ -0,0 +1,79 @@
+#ifndef SCENEBVH_H
+#define SCENEBVH_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "fastbvh/Ray.h"
+
+#include "BVHBuilder.h"
+#include "MeshBVH.h"
+
+/**
+ * The hits of a ray with the mesh with index mesh of a SceneBVH, which
+ * are stored in SceneHits::hits[begin, end).
+ */
+struct SceneHitRange {
+    uint32_t mesh;
+    uint32_t begin;
+    uint32_t end;
+};
+
+/**
+ * All intersections of a ray with a scene, grouped by mesh.
+ * ranges is sorted by mesh index, the hits of each mesh are sorted by t
+ * exactly as returned by MeshBVH::getAllIntersections.
+ */
+struct SceneHits {
+    std::vector<RayHit> hits;
+    std::vector<SceneHitRange> ranges;
+
+    void clear() { hits.clear(); ranges.clear(); }
+};
+
+/**
+ * Two-level bounding volume hierarchy over all meshes of a scene.
+ *
+ * The top level is a BVH over the root boxes of the meshes' own BVHs
+ * (see Mesh::buildBVH), the bottom level are these MeshBVHs.
+ * A ray is traced through the whole scene at once and its hits carry the
+ * index of the mesh they belong to, so that all objects can be voxelized
+ * in a single sweep instead of one pass per mesh.
+ */
+class SceneBVH {
+    public:
+    /**
+     * Builds the top level over the BVHs of all meshes, in mesh index
+     * order. Meshes without one (null) are skipped. The BVHs must
+     * outlive the tree.
+     */
+    explicit SceneBVH(const std::vector<const MeshBVH*>& meshBVHs);
+
+    /**
+     * Collects all intersections of ray with the scene into hits (which
+     * is cleared first).
+     * meshHits is scratch space, both are meant to be reused between
+     * calls to avoid allocations.
+     */
+    void getAllIntersections(const Ray& ray, SceneHits& hits, std::vector<RayHit>& meshHits) const;
+
+    /**
+     * Same as getAllIntersections, for all rays of packet at once (see
+     * MeshBVH::getAllIntersections4). hits[i] receives the intersections
+     * of the i-th ray, meshHits must hold four vectors of scratch space.
+     */
+    void getAllIntersections4(const AxisRayPacket4& packet, SceneHits* hits, std::vector<RayHit>* meshHits) const;
+
+    const std::vector<MeshBVHNode>& nodes() const { return nodes_; }
+
+    private:
+    static void appendMeshHits(uint32_t mesh, const std::vector<RayHit>& meshHits, SceneHits& hits);
+    static void sortRanges(SceneHits& hits);
+
+    std::vector<MeshBVHNode> nodes_;
+    // indexed by the leaves of the top level
+    std::vector<uint32_t> meshIndex_;
+    std::vector<const MeshBVH*> meshBVHs_;
+};
+
+#endif /* SCENEBVH_H */
@@ -0,0 +1,356 @@
+#include "SceneCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <iostream>
+#include <memory>
+
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+static const char magic[8] = {'S','2','V','C','A','C','H','E'};
+static const uint32_t version = 3;
+
+struct SceneCache::Header {
+    char magic[8];
+    uint32_t version;
+    int32_t maxObjects;
+    float edgeLengthThreshold;
+    uint32_t layout;
+    float gridStart[3];
+    float gridStep[3];
+    uint64_t objSize;
+    int64_t objMtimeSec;
+    int64_t objMtimeNsec;
+};
+
+SceneCache::SceneCache(const std::string& filename, const std::string& objFile,
+                       int maxObjects, float edgeLengthThreshold,
+                       TriangleStore::Layout layout, const VertexGrid& grid)
+    : filename_(filename), objFile_(objFile),
+      maxObjects_(maxObjects), edgeLengthThreshold_(edgeLengthThreshold),
+      layout_(layout), grid_(grid)
+{
+}
+
+SceneCache::Header SceneCache::header() const
+{
+    struct stat st;
+    if(::stat(objFile_.c_str(), &st) != 0) {
+        throw std::runtime_error("could not stat '" + objFile_ + "'");
+    }
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.maxObjects = maxObjects_;
+    h.edgeLengthThreshold = edgeLengthThreshold_;
+    h.layout = layout_;
+    if(layout_ == TriangleStore::Quantized) {
+        for(int k=0; k<3; ++k) {
+            h.gridStart[k] = grid_.start[k];
+            h.gridStep[k] = grid_.step[k];
+        }
+    }
+    h.objSize = st.st_size;
+    h.objMtimeSec = st.st_mtim.tv_sec;
+    h.objMtimeNsec = st.st_mtim.tv_nsec;
+    return h;
+}
+
+//
+// writing
+//
+
+template<class T>
+static void put(std::ostream& o, const T& t)
+{
+    o.write(reinterpret_cast<const char*>(&t), sizeof(T));
+}
+
+template<class T>
+static void putArray(std::ostream& o, const T* t, size_t n)
+{
+    o.write(reinterpret_cast<const char*>(t), n*sizeof(T));
+}
+
+// Pads the file to the alignment of the triangle arrays, which are used
+// in place when the cache is read.
+static const size_t arrayAlignment = 16;
+
+static void putPadding(std::ostream& o)
+{
+    static const char zeros[arrayAlignment] = {0};
+    const size_t pos = o.tellp();
+    o.write(zeros, (arrayAlignment - pos % arrayAlignment) % arrayAlignment);
+}
+
+void SceneCache::write(const Scene& scene) const
+{
+    // write to a temporary file first, so that an interrupted run
+    // never leaves a truncated cache behind
+    const std::string tmpFile = filename_ + ".tmp";
+    std::ofstream o(tmpFile.c_str(), std::ios::binary);
+    if(!o) {
+        throw std::runtime_error("could not write '" + tmpFile + "'");
+    }
+
+    put(o, header());
+    put(o, uint64_t(scene.meshes.size()));
+
+    for(const Mesh& m : scene.meshes) {
+        const std::string name = m.name();
+        put(o, uint64_t(name.size()));
+        putArray(o, name.data(), name.size());
+        put(o, uint32_t(m.label()));
+
+        put(o, uint64_t(m.vertices.size()));
+        for(const Vector3& v : m.vertices) {
+            const float f[3] = {v[0], v[1], v[2]};
+            putArray(o, f, 3);
+        }
+        put(o, uint64_t(m.faces.size()));
+        putArray(o, m.faces.data(), m.faces.size());
+
+        const MeshBVH* bvh = m.bvh();
+        const uint64_t nNodes = bvh ? bvh->nodes().size() : 0;
+        put(o, nNodes);
+        if(nNodes == 0) {
+            continue;
+        }
+        for(const MeshBVHNode& n : bvh->nodes()) {
+            const float f[6] = {n.bbox.min[0], n.bbox.min[1], n.bbox.min[2],
+                                n.bbox.max[0], n.bbox.max[1], n.bbox.max[2]};
+            putArray(o, f, 6);
+            const uint32_t u[3] = {n.start, n.nPrims, n.rightOffset};
+            putArray(o, u, 3);
+        }
+        const TriangleStore& tris = bvh->triangles();
+        put(o, uint32_t(tris.layout()));
+        put(o, uint64_t(tris.size()));
+        if(tris.layout() == TriangleStore::Expanded) {
+            putPadding(o);
+            for(int a=0; a<TriangleStore::NArrays; ++a) {
+                putArray(o, tris.array(TriangleStore::Array(a)), tris.size());
+            }
+            continue;
+        }
+        put(o, uint64_t(tris.nVertices()));
+        const float g[6] = {tris.grid().start[0], tris.grid().start[1], tris.grid().start[2],
+                            tris.grid().step[0], tris.grid().step[1], tris.grid().step[2]};
+        putArray(o, g, 6);
+        putArray(o, tris.base(), 3);
+        putPadding(o);
+        putArray(o, tris.indices(), 3*tris.size());
+        putPadding(o);
+        if(tris.layout() == TriangleStore::Indexed) {
+            putArray(o, tris.vertices(), 3*tris.nVertices());
+        }
+        else {
+            putArray(o, tris.quantizedVertices(), 3*tris.nVertices());
+        }
+    }
+
+    o.close();
+    if(!o || std::rename(tmpFile.c_str(), filename_.c_str()) != 0) {
+        std::remove(tmpFile.c_str());
+        throw std::runtime_error("could not write '" + filename_ + "'");
+    }
+}
+
+//
+// reading
+//
+
+namespace {
+
+// Sequential reader over the mapped cache file.
+// Running past the end marks the cache as invalid.
+class Cursor {
+    public:
+    Cursor(const char* p, size_t size) : begin_(p), p_(p), end_(p + size), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    template<class T>
+    T get() {
+        T t = T();
+        getArray(&t, 1);
+        return t;
+    }
+
+    template<class T>
+    void getArray(T* t, size_t n) {
+        if(!ok_ || n > size_t(end_ - p_) / sizeof(T)) {
+            ok_ = false;
+            return;
+        }
+        std::memcpy(t, p_, n*sizeof(T));
+        p_ += n*sizeof(T);
+    }
+
+    /**
+     * Returns a pointer to n elements in place, after skipping the
+     * padding written by putPadding(), or 0 if there are not that many.
+     */
+    template<class T>
+    const T* view(size_t n) {
+        const size_t skip = (arrayAlignment - size_t(p_ - begin_) % arrayAlignment) % arrayAlignment;
+        if(!ok_ || skip > size_t(end_ - p_) || n > size_t(end_ - p_ - skip) / sizeof(T)) {
+            ok_ = false;
+            return 0;
+        }
+        const T* t = reinterpret_cast<const T*>(p_ + skip);
+        p_ += skip + n*sizeof(T);
+        return t;
+    }
+
+    /** Returns a count of elements of size elemSize, checked against the size left */
+    size_t getCount(size_t elemSize) {
+        const uint64_t n = get<uint64_t>();
+        if(n > size_t(end_ - p_) / elemSize) {
+            ok_ = false;
+            return 0;
+        }
+        return n;
+    }
+
+    private:
+    const char* begin_;
+    const char* p_;
+    const char* end_;
+    bool ok_;
+};
+
+} /* anonymous namespace */
+
+// Checks that a tree read from the cache only refers to existing nodes
+// and triangles, is shallow enough for the traversal stack, and that
+// compact triangles only refer to existing vertices.
+static bool validBVH(const std::vector<MeshBVHNode>& nodes, const TriangleStore& tris)
+{
+    std::vector<uint32_t> depth(nodes.size(), 0);
+    depth[0] = 1;
+    for(size_t ni=0; ni<nodes.size(); ++ni) {
+        const MeshBVHNode& n = nodes[ni];
+        if(n.rightOffset == 0) {
+            if(uint64_t(n.start) + n.nPrims > tris.size()) {
+                return false;
+            }
+            continue;
+        }
+        // children follow their parent, so depth[ni] is final here
+        if(ni + n.rightOffset >= nodes.size() || depth[ni] + 1 > bvhMaxStackSize - 2) {
+            return false;
+        }
+        depth[ni+1] = std::max(depth[ni+1], depth[ni] + 1);
+        depth[ni+n.rightOffset] = std::max(depth[ni+n.rightOffset], depth[ni] + 1);
+    }
+    if(tris.layout() != TriangleStore::Expanded) {
+        const uint32_t* indices = tris.indices();
+        for(size_t i=0; i<3*tris.size(); ++i) {
+            if(indices[i] >= tris.nVertices()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SceneCache::read(Scene& scene) const
+{
+    struct stat st;
+    if(::stat(filename_.c_str(), &st) != 0) {
+        return false;
+    }
+    // the triangles are used in place, the mapping lives as long as any
+    // of them
+    std::shared_ptr<const MappedFile> file = std::make_shared<MappedFile>(filename_, false);
+    Cursor c(file->data(), file->size());
+
+    const Header expected = header();
+    const Header h = c.get<Header>();
+    if(!c.ok() || std::memcmp(&h, &expected, sizeof(Header)) != 0) {
+        return false;
+    }
+
+    std::vector<Mesh> meshes(c.getCount(1));
+    for(Mesh& m : meshes) {
+        std::string name(c.getCount(1), ' ');
+        c.getArray(&name[0], name.size());
+        m.setName(name);
+        m.setLabel(c.get<uint32_t>());
+
+        m.vertices.resize(c.getCount(3*sizeof(float)));
+        for(Vector3& v : m.vertices) {
+            float f[3];
+            c.getArray(f, 3);
+            v = Vector3(f[0], f[1], f[2]);
+        }
+        m.faces.resize(c.getCount(sizeof(Mesh::Tri)));
+        c.getArray(m.faces.data(), m.faces.size());
+        for(const Mesh::Tri& f : m.faces) {
+            if(f[0] >= m.vertices.size() || f[1] >= m.vertices.size() || f[2] >= m.vertices.size()) {
+                return false;
+            }
+        }
+
+        std::vector<MeshBVHNode> nodes(c.getCount(6*sizeof(float) + 3*sizeof(uint32_t)));
+        if(nodes.empty()) {
+            continue;
+        }
+        for(MeshBVHNode& n : nodes) {
+            float f[6];
+            uint32_t u[3];
+            c.getArray(f, 6);
+            c.getArray(u, 3);
+            n.bbox = BBox(Vector3(f[0], f[1], f[2]), Vector3(f[3], f[4], f[5]));
+            n.start = u[0];
+            n.nPrims = u[1];
+            n.rightOffset = u[2];
+        }
+        const uint32_t layout = c.get<uint32_t>();
+        const size_t nTris = c.getCount(3*sizeof(uint32_t));
+        TriangleStore tris;
+        if(layout == TriangleStore::Expanded) {
+            const float* arrays = c.view<float>(TriangleStore::NArrays*nTris);
+            tris = TriangleStore(nTris, arrays, file);
+        }
+        else if(layout == TriangleStore::Indexed || layout == TriangleStore::Quantized) {
+            const size_t nVertices = c.getCount(3*sizeof(uint16_t));
+            float g[6];
+            int32_t base[3];
+            c.getArray(g, 6);
+            c.getArray(base, 3);
+            VertexGrid grid;
+            grid.start = Vector3(g[0], g[1], g[2]);
+            grid.step = Vector3(g[3], g[4], g[5]);
+            const uint32_t* indices = c.view<uint32_t>(3*nTris);
+            const void* vertices = layout == TriangleStore::Indexed
+                                   ? static_cast<const void*>(c.view<float>(3*nVertices))
+                                   : static_cast<const void*>(c.view<uint16_t>(3*nVertices));
+            tris = TriangleStore(TriangleStore::Layout(layout), nTris, indices, nVertices, vertices,
+                                 grid, base, file);
+        }
+        else {
+            return false;
+        }
+        if(!c.ok() || !validBVH(nodes, tris)) {
+            return false;
+        }
+        m.setBVH(std::unique_ptr<MeshBVH>(new MeshBVH(std::move(nodes), std::move(tris))));
+    }
+    if(!c.ok()) {
+        return false;
+    }
+
+    for(Mesh& m : meshes) {
+        scene.meshes.push_back(std::move(m));
+    }
+    return true;
+}
@@ -0,0 +1,64 @@
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include <string>
+
+#include "Scene.h"
+
+/**
+ * Binary cache of a parsed scene, including the BVH of every mesh.
+ *
+ * Reading an .obj file and building the BVHs dominates the startup time
+ * of surface2volume. The cache stores the result (vertices, faces, names,
+ * labels, flattened BVH nodes and triangles of each mesh) so that later
+ * runs on the same input only need to map it. The triangles, the bulk
+ * of the file, are used in place from the mapping, which their
+ * TriangleStores keep alive; the other parts are copied, since their
+ * in-memory layout (SSE vectors and boxes) differs from the file's.
+ * Before a tree is used, its nodes and vertex indices are checked to
+ * stay within their arrays, so a corrupted cache is rejected instead of
+ * being traversed out of bounds.
+ *
+ * A cache is only used if it was written for the same .obj file
+ * (identified by its size and modification time) with the same
+ * settings (including the triangle layout, see Mesh::buildCompactBVH);
+ * otherwise read() returns false and it should be rewritten.
+ * The format uses native byte order.
+ */
+class SceneCache {
+    public:
+    /**
+     * layout is the layout the BVHs are built with; grid is only used
+     * for TriangleStore::Quantized.
+     */
+    SceneCache(const std::string& filename, const std::string& objFile,
+               int maxObjects, float edgeLengthThreshold,
+               TriangleStore::Layout layout = TriangleStore::Expanded,
+               const VertexGrid& grid = VertexGrid());
+
+    /**
+     * Appends the cached meshes (with BVHs) to scene if the cache exists,
+     * matches the input and is intact. Returns whether it did.
+     */
+    bool read(Scene& scene) const;
+
+    /**
+     * Writes scene, whose BVHs must have been built.
+     * Throws std::runtime_error on failure.
+     */
+    void write(const Scene& scene) const;
+
+    private:
+    struct Header;
+
+    Header header() const;
+
+    std::string filename_;
+    std::string objFile_;
+    int maxObjects_;
+    float edgeLengthThreshold_;
+    TriangleStore::Layout layout_;
+    VertexGrid grid_;
+};
+
+#endif /* SCENECACHE_H */
@@ -0,0 +1,147 @@
+#include "TraversalStats.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+
+namespace {
+
+typedef std::vector<std::array<TraversalCounters, 3> > Table;
+
+void addTable(Table& to, const Table& from)
+{
+    if(to.size() < from.size()) {
+        to.resize(from.size());
+    }
+    for(size_t i=0; i<from.size(); ++i) {
+        for(int axis=0; axis<3; ++axis) {
+            to[i][axis] += from[i][axis];
+        }
+    }
+}
+
+std::mutex totalsMutex;
+Table totalsTable;
+
+// The counters of one thread, merged into the totals when it exits.
+struct ThreadTable {
+    Table table;
+    uint32_t mesh;
+    int axis;
+
+    ThreadTable() : mesh(0), axis(0) {}
+
+    ~ThreadTable() {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        addTable(totalsTable, table);
+    }
+};
+
+ThreadTable& threadTable()
+{
+    static thread_local ThreadTable t;
+    return t;
+}
+
+} /* anonymous namespace */
+
+TraversalCounters& TraversalCounters::operator+=(const TraversalCounters& other)
+{
+    rays += other.rays;
+    nodes += other.nodes;
+    triangleTests += other.triangleTests;
+    hits += other.hits;
+    mergedHits += other.mergedHits;
+    return *this;
+}
+
+void TraversalStats::setTarget(uint32_t mesh, int axis)
+{
+    ThreadTable& t = threadTable();
+    t.mesh = mesh;
+    t.axis = axis;
+}
+
+void TraversalStats::setMesh(uint32_t mesh)
+{
+    threadTable().mesh = mesh;
+}
+
+void TraversalStats::add(const TraversalCounters& counters)
+{
+    ThreadTable& t = threadTable();
+    if(t.mesh >= t.table.size()) {
+        t.table.resize(t.mesh + 1);
+    }
+    t.table[t.mesh][t.axis] += counters;
+}
+
+std::vector<std::array<TraversalCounters, 3> > TraversalStats::totals()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    Table totals = totalsTable;
+    addTable(totals, threadTable().table);
+    return totals;
+}
+
+void TraversalStats::reset()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    totalsTable.clear();
+    threadTable().table.clear();
+}
+
+void TraversalStats::report(std::ostream& out, const std::vector<std::string>& names, size_t maxRows)
+{
+    const Table totals = TraversalStats::totals();
+    std::vector<std::pair<TraversalCounters, size_t> > meshes;
+    TraversalCounters all, axes[3];
+    for(size_t i=0; i<totals.size(); ++i) {
+        TraversalCounters sum;
+        for(int axis=0; axis<3; ++axis) {
+            sum += totals[i][axis];
+            axes[axis] += totals[i][axis];
+        }
+        all += sum;
+        if(sum.rays > 0) {
+            meshes.push_back(std::make_pair(sum, i));
+        }
+    }
+    std::sort(meshes.begin(), meshes.end(),
+              [](const std::pair<TraversalCounters, size_t>& a, const std::pair<TraversalCounters, size_t>& b) {
+                  return a.first.cost() > b.first.cost() || (a.first.cost() == b.first.cost() && a.second < b.second);
+              });
+
+    auto perRay = [](uint64_t n, uint64_t rays) { return rays > 0 ? double(n) / rays : 0.0; };
+    auto share = [&](uint64_t cost) { return all.cost() > 0 ? 100.0 * cost / all.cost() : 0.0; };
+
+    out << std::left << std::setw(8) << "label" << std::setw(24) << "object" << std::right
+        << std::setw(8) << "cost %" << std::setw(12) << "rays" << std::setw(11) << "nodes/ray"
+        << std::setw(11) << "tests/ray" << std::setw(10) << "hits/ray" << std::setw(10) << "merged %"
+        << std::setw(22) << "cost % x / y / z" << std::endl;
+    const std::ios::fmtflags flags = out.flags();
+    const std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+    for(size_t r=0; r<std::min(maxRows, meshes.size()); ++r) {
+        const TraversalCounters& c = meshes[r].first;
+        const size_t i = meshes[r].second;
+        const std::string name = i < names.size() ? names[i] : "";
+        out << std::left << std::setw(8) << i+1 << std::setw(24) << name.substr(0, 23) << std::right
+            << std::setw(8) << share(c.cost()) << std::setw(12) << c.rays
+            << std::setw(11) << perRay(c.nodes, c.rays) << std::setw(11) << perRay(c.triangleTests, c.rays)
+            << std::setw(10) << perRay(c.hits, c.rays) << std::setw(10) << 100.0 * perRay(c.mergedHits, c.hits)
+            << std::setw(10) << share(totals[i][0].cost()) << " / " << std::setw(4) << share(totals[i][1].cost())
+            << " / " << std::setw(4) << share(totals[i][2].cost()) << std::endl;
+    }
+    if(meshes.size() > maxRows) {
+        out << "(" << meshes.size() - maxRows << " more objects)" << std::endl;
+    }
+    for(int axis=0; axis<3; ++axis) {
+        const TraversalCounters& c = axes[axis];
+        out << "axis " << axis << ": " << share(c.cost()) << "% of the cost, " << c.rays << " rays, "
+            << perRay(c.nodes, c.rays) << " nodes/ray, " << perRay(c.triangleTests, c.rays) << " tests/ray, "
+            << c.hits << " hits (" << c.mergedHits << " merged)" << std::endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
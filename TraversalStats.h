@@ -0,0 +1,92 @@
+#ifndef TRAVERSALSTATS_H
+#define TRAVERSALSTATS_H
+
+#include <array>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Work done while tracing rays through the triangles of one mesh.
+ */
+struct TraversalCounters {
+    uint64_t rays;          /**< rays traced through the mesh (crossing it, when rasterizing) */
+    uint64_t nodes;         /**< BVH nodes visited */
+    uint64_t triangleTests; /**< ray-triangle tests */
+    uint64_t hits;          /**< intersections found by these tests */
+    uint64_t mergedHits;    /**< of these, dropped as coinciding within float precision */
+
+    TraversalCounters() : rays(0), nodes(0), triangleTests(0), hits(0), mergedHits(0) {}
+
+    TraversalCounters& operator+=(const TraversalCounters& other);
+
+    /** Rough cost in units of box or triangle tests. */
+    uint64_t cost() const { return nodes + triangleTests; }
+};
+
+/**
+ * Optional counters of the work done by the BVH traversal and the
+ * ray-triangle tests, per mesh and ray axis, to find the objects which
+ * make a run slow (e.g. huge triangles or slivers, see the edge length
+ * threshold of Mesh::buildBVH).
+ *
+ * The counters are only compiled in with S2V_TRAVERSAL_STATS defined
+ * (cmake -DTRAVERSAL_STATS=ON); otherwise the TRAVERSAL_* macros below
+ * expand to nothing and the traversal is unchanged.
+ *
+ * Each thread adds to its own table, attributed to the mesh and axis
+ * last set with setTarget() (or setMesh()) on that thread; the table is
+ * merged into the totals when the thread exits. Callers of the traversal
+ * set the target, the traversal itself only counts.
+ */
+class TraversalStats {
+    public:
+    static bool enabled() {
+#ifdef S2V_TRAVERSAL_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /** Attributes the following traversals of this thread to mesh and ray axis. */
+    static void setTarget(uint32_t mesh, int axis);
+
+    /** Same, keeping the current axis (e.g. for the meshes of a SceneBVH). */
+    static void setMesh(uint32_t mesh);
+
+    /** Adds to the counters of the current target of this thread. */
+    static void add(const TraversalCounters& counters);
+
+    /**
+     * The counters of every mesh and axis, summed over all threads which
+     * have exited and the calling one.
+     */
+    static std::vector<std::array<TraversalCounters, 3> > totals();
+
+    /** Clears the totals and the counters of the calling thread. */
+    static void reset();
+
+    /**
+     * Prints the totals of the at most maxRows most expensive meshes,
+     * sorted by decreasing cost, and the totals per axis. names[i] is
+     * the name of mesh i (may be shorter).
+     */
+    static void report(std::ostream& out, const std::vector<std::string>& names, size_t maxRows = 20);
+};
+
+#ifdef S2V_TRAVERSAL_STATS
+#define TRAVERSAL_COUNT(counter, n) ((counter) += (n))
+#define TRAVERSAL_ADD(counters) TraversalStats::add(counters)
+#define TRAVERSAL_TARGET(mesh, axis) TraversalStats::setTarget((mesh), (axis))
+#define TRAVERSAL_MESH(mesh) TraversalStats::setMesh(mesh)
+#else
+// n is not evaluated, but still counts as used
+#define TRAVERSAL_COUNT(counter, n) ((void)sizeof(n))
+#define TRAVERSAL_ADD(counters) ((void)0)
+#define TRAVERSAL_TARGET(mesh, axis) ((void)0)
+#define TRAVERSAL_MESH(mesh) ((void)0)
+#endif
+
+#endif /* TRAVERSALSTATS_H */
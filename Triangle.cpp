@@ -8,14 +8,21 @@ int triangle_intersection( const Vector3 V1, // Triangle vertices
                            const Vector3 D,  //Ray direction
                            float* out)  
 {
-    Vector3 e1, e2;  //Edge1, Edge2
+    //Find vectors for two edges sharing V1
+    return triangle_intersection_edges(V1, V2 - V1, V3 - V1, O, D, out);
+}
+
+int triangle_intersection_edges( const Vector3 V1, // Triangle vertex
+                                 const Vector3 e1, // Edge V2-V1
+                                 const Vector3 e2, // Edge V3-V1
+                                 const Vector3 O,  //Ray origin
+                                 const Vector3 D,  //Ray direction
+                                 float* out)
+{
     Vector3 P, Q, T;
     float det, inv_det, u, v;
     float t;
     
-    //Find vectors for two edges sharing V1
-    e1 = V2 - V1;
-    e2 = V3 - V1;
     //Begin calculating determinant - also used to calculate u parameter
     P = D ^ e2;
     //if determinant is near zero, ray lies in plane of triangle
@@ -49,4 +56,80 @@ int triangle_intersection( const Vector3 V1, // Triangle vertices
  
     //No hit, no win
     return 0;
-}
\ No newline at end of file
+}
+
+int triangle_intersection4( const Vector3 V1, // Triangle vertices
+                            const Vector3 V2,
+                            const Vector3 V3,
+                            const __m128 Ox, //Ray origins
+                            const __m128 Oy,
+                            const __m128 Oz,
+                            const Vector3 D, //Common ray direction
+                            __m128* out)
+{
+    return triangle_intersection4_edges(V1, V2 - V1, V3 - V1, Ox, Oy, Oz, D, out);
+}
+
+int triangle_intersection4_edges( const Vector3 V1, // Triangle vertex
+                                  const Vector3 e1, // Edge V2-V1
+                                  const Vector3 e2, // Edge V3-V1
+                                  const __m128 Ox, //Ray origins
+                                  const __m128 Oy,
+                                  const __m128 Oz,
+                                  const Vector3 D, //Common ray direction
+                                  __m128* out)
+{
+    Vector3 P;
+    float det, inv_det;
+    
+    //The direction is shared by all lanes, so everything depending only
+    //on D and the triangle is computed once, as in the scalar version.
+    P = D ^ e2;
+    det = e1 * P;
+    if(det > -eps && det < eps) return 0;
+    inv_det = 1.f / det;
+    
+    const __m128 invDet = _mm_set1_ps(inv_det);
+    const __m128 zero   = _mm_setzero_ps();
+    const __m128 one    = _mm_set1_ps(1.f);
+    
+    //calculate distance from V1 to ray origins
+    const __m128 Tx = _mm_sub_ps(Ox, _mm_set1_ps(V1.x));
+    const __m128 Ty = _mm_sub_ps(Oy, _mm_set1_ps(V1.y));
+    const __m128 Tz = _mm_sub_ps(Oz, _mm_set1_ps(V1.z));
+    
+    //u = (T * P) * inv_det
+    __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Tx, _mm_set1_ps(P.x)),
+                                     _mm_mul_ps(Ty, _mm_set1_ps(P.y))),
+                          _mm_mul_ps(Tz, _mm_set1_ps(P.z)));
+    u = _mm_mul_ps(u, invDet);
+    __m128 mask = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one));
+    if(_mm_movemask_ps(mask) == 0) return 0;
+    
+    //Q = T ^ e1
+    const __m128 e1x = _mm_set1_ps(e1.x);
+    const __m128 e1y = _mm_set1_ps(e1.y);
+    const __m128 e1z = _mm_set1_ps(e1.z);
+    const __m128 Qx = _mm_sub_ps(_mm_mul_ps(Ty, e1z), _mm_mul_ps(Tz, e1y));
+    const __m128 Qy = _mm_sub_ps(_mm_mul_ps(Tz, e1x), _mm_mul_ps(Tx, e1z));
+    const __m128 Qz = _mm_sub_ps(_mm_mul_ps(Tx, e1y), _mm_mul_ps(Ty, e1x));
+    
+    //v = (D * Q) * inv_det
+    __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(D.x), Qx),
+                                     _mm_mul_ps(_mm_set1_ps(D.y), Qy)),
+                          _mm_mul_ps(_mm_set1_ps(D.z), Qz));
+    v = _mm_mul_ps(v, invDet);
+    mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+    mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+    if(_mm_movemask_ps(mask) == 0) return 0;
+    
+    //t = (e2 * Q) * inv_det
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(e2.x), Qx),
+                                     _mm_mul_ps(_mm_set1_ps(e2.y), Qy)),
+                          _mm_mul_ps(_mm_set1_ps(e2.z), Qz));
+    t = _mm_mul_ps(t, invDet);
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(eps)));
+    
+    *out = t;
+    return _mm_movemask_ps(mask);
+}
@@ -5,6 +5,8 @@
 #include <iostream>
 #include <stdexcept>
 
+#include <xmmintrin.h>
+
 #include "fastbvh/Object.h"
 
 int triangle_intersection( const Vector3 V1, // Triangle vertices
@@ -14,6 +16,43 @@ int triangle_intersection( const Vector3 V1, // Triangle vertices
                            const Vector3 D,  //Ray direction
                            float* out);
 
+/**
+ * Four-lane SSE version of triangle_intersection for four rays sharing
+ * the direction D, with origins (Ox[i], Oy[i], Oz[i]).
+ * Returns a bit mask of the lanes which hit the triangle and stores
+ * their distances in out. Computes the same values as the scalar
+ * version, lane by lane.
+ */
+int triangle_intersection4( const Vector3 V1, // Triangle vertices
+                            const Vector3 V2,
+                            const Vector3 V3,
+                            const __m128 Ox, //Ray origins
+                            const __m128 Oy,
+                            const __m128 Oz,
+                            const Vector3 D, //Common ray direction
+                            __m128* out);
+
+/**
+ * Same as triangle_intersection and triangle_intersection4, for
+ * triangles given by V1 and the precomputed edges e1 = V2-V1 and
+ * e2 = V3-V1 (see TriangleStore).
+ */
+int triangle_intersection_edges( const Vector3 V1, // Triangle vertex
+                                 const Vector3 e1, // Edge V2-V1
+                                 const Vector3 e2, // Edge V3-V1
+                                 const Vector3 O,  //Ray origin
+                                 const Vector3 D,  //Ray direction
+                                 float* out);
+
+int triangle_intersection4_edges( const Vector3 V1, // Triangle vertex
+                                  const Vector3 e1, // Edge V2-V1
+                                  const Vector3 e2, // Edge V3-V1
+                                  const __m128 Ox, //Ray origins
+                                  const __m128 Oy,
+                                  const __m128 Oz,
+                                  const Vector3 D, //Common ray direction
+                                  __m128* out);
+
 struct Triangle : public Object {
     Vector3 v1, v2, v3;
     uint32_t l;
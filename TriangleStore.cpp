@@ -0,0 +1,82 @@
+#include "TriangleStore.h"
+
+TriangleStore::TriangleStore(size_t n)
+    : size_(n), layout_(Expanded), indices_(0), vertices_(0), quantized_(0), nVertices_(0),
+      arena_(new float[NArrays*n]), base_()
+{
+    arrays_ = arena_.get();
+}
+
+TriangleStore::TriangleStore(size_t n, const float* arrays, std::shared_ptr<const void> owner)
+    : size_(n), layout_(Expanded), arrays_(arrays), indices_(0), vertices_(0), quantized_(0), nVertices_(0),
+      owner_(std::move(owner)), base_()
+{
+}
+
+TriangleStore::TriangleStore(std::vector<uint32_t> indices, std::vector<float> vertices)
+    : size_(indices.size() / 3), layout_(Indexed), arrays_(0), quantized_(0), nVertices_(vertices.size() / 3),
+      ownedIndices_(std::move(indices)), ownedVertices_(std::move(vertices)), base_()
+{
+    indices_ = ownedIndices_.data();
+    vertices_ = ownedVertices_.data();
+}
+
+TriangleStore::TriangleStore(std::vector<uint32_t> indices, std::vector<uint16_t> vertices,
+                             const VertexGrid& grid, const int32_t base[3])
+    : size_(indices.size() / 3), layout_(Quantized), arrays_(0), vertices_(0), nVertices_(vertices.size() / 3),
+      ownedIndices_(std::move(indices)), ownedQuantized_(std::move(vertices)), grid_(grid)
+{
+    indices_ = ownedIndices_.data();
+    quantized_ = ownedQuantized_.data();
+    for(int k=0; k<3; ++k) {
+        base_[k] = base[k];
+    }
+}
+
+TriangleStore::TriangleStore(Layout layout, size_t n, const uint32_t* indices, size_t nVertices,
+                             const void* vertices, const VertexGrid& grid, const int32_t base[3],
+                             std::shared_ptr<const void> owner)
+    : size_(n), layout_(layout), arrays_(0), indices_(indices),
+      vertices_(layout == Indexed ? static_cast<const float*>(vertices) : 0),
+      quantized_(layout == Quantized ? static_cast<const uint16_t*>(vertices) : 0),
+      nVertices_(nVertices), owner_(std::move(owner)), grid_(grid)
+{
+    for(int k=0; k<3; ++k) {
+        base_[k] = base[k];
+    }
+}
+
+void TriangleStore::setIndices(std::vector<uint32_t> indices)
+{
+    ownedIndices_ = std::move(indices);
+    indices_ = ownedIndices_.data();
+    size_ = ownedIndices_.size() / 3;
+}
+
+void TriangleStore::set(size_t i, const Vector3& v1, const Vector3& v2, const Vector3& v3)
+{
+    const Vector3 e1 = v2 - v1;
+    const Vector3 e2 = v3 - v1;
+    for(int k=0; k<3; ++k) {
+        array(Array(V1X+k))[i] = v1[k];
+        array(Array(E1X+k))[i] = e1[k];
+        array(Array(E2X+k))[i] = e2[k];
+    }
+}
+
+BBox TriangleStore::bbox(size_t i) const
+{
+    Vector3 a, e1, e2;
+    get(i, a, e1, e2);
+    const Vector3 b = a + e1;
+    const Vector3 c = a + e2;
+    return BBox(min(a, min(b,c)), max(a, max(b,c)));
+}
+
+size_t TriangleStore::memoryUsage() const
+{
+    if(layout_ == Expanded) {
+        return expandedMemoryUsage();
+    }
+    return 3*size_*sizeof(uint32_t) + 3*nVertices_*(layout_ == Indexed ? sizeof(float) : sizeof(uint16_t));
+}
@@ -0,0 +1,197 @@
+#ifndef TRIANGLESTORE_H
+#define TRIANGLESTORE_H
+
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+#include "fastbvh/BBox.h"
+#include "fastbvh/Ray.h"
+#include "fastbvh/Vector3.h"
+
+#include "Triangle.h"
+
+/**
+ * A regular grid of points start + i*step (per axis, for integer i),
+ * to which the vertices of quantized triangles are snapped.
+ */
+struct VertexGrid {
+    Vector3 start;
+    Vector3 step;
+};
+
+/**
+ * Contiguous storage for the triangles of one mesh, in one of two
+ * layouts.
+ *
+ * Expanded (the default): structure-of-arrays of each triangle's first
+ * vertex and the two edges e1 = v2-v1, e2 = v3-v1 that the
+ * Moeller-Trumbore test needs, i.e. 9 floats per triangle. All arrays
+ * live in a single allocation.
+ *
+ * Compact: the mesh's vertices are stored once (welded, see
+ * Mesh::buildCompactBVH) and each triangle holds the indices of its three
+ * vertices; the edges are computed on the fly. The vertices are either
+ * floats or, when quantized, 16 bit coordinates on a VertexGrid
+ * relative to a base point of the grid. For a closed mesh of n
+ * triangles (about n/2 vertices), this takes 18 or 15 instead of 36
+ * bytes per triangle, at the price of fetching three vertices per test.
+ *
+ * The arrays of either layout are owned by the store, or belong to an
+ * owner which the store keeps alive, e.g. a memory mapped SceneCache.
+ */
+class TriangleStore {
+    public:
+    enum Array { V1X, V1Y, V1Z, E1X, E1Y, E1Z, E2X, E2Y, E2Z, NArrays };
+
+    enum Layout {
+        Expanded,  /**< first vertex and edges of every triangle */
+        Indexed,   /**< vertex indices into shared float vertices */
+        Quantized  /**< vertex indices into shared grid vertices */
+    };
+
+    TriangleStore()
+        : size_(0), layout_(Expanded), arrays_(0), indices_(0), vertices_(0), quantized_(0), nVertices_(0),
+          base_() {}
+
+    /** Expanded storage for n triangles, see set(). */
+    explicit TriangleStore(size_t n);
+
+    /**
+     * Expanded storage for n triangles in the NArrays arrays of n floats
+     * each at arrays, which owner keeps alive.
+     */
+    TriangleStore(size_t n, const float* arrays, std::shared_ptr<const void> owner);
+
+    /**
+     * Indexed storage for the triangles with the vertex indices
+     * indices[3*i], indices[3*i+1], indices[3*i+2] into vertices, which
+     * holds x, y, z of every vertex.
+     */
+    TriangleStore(std::vector<uint32_t> indices, std::vector<float> vertices);
+
+    /**
+     * Quantized storage: as above, but vertex k lies at the grid point
+     * base + (vertices[3*k], vertices[3*k+1], vertices[3*k+2]) of grid.
+     */
+    TriangleStore(std::vector<uint32_t> indices, std::vector<uint16_t> vertices,
+                  const VertexGrid& grid, const int32_t base[3]);
+
+    /**
+     * Indexed or quantized storage of n triangles in arrays which owner
+     * keeps alive: 3*n indices and, depending on layout, 3*nVertices
+     * floats or 16 bit grid coordinates at vertices (grid and base are
+     * only used when quantized).
+     */
+    TriangleStore(Layout layout, size_t n, const uint32_t* indices, size_t nVertices, const void* vertices,
+                  const VertexGrid& grid, const int32_t base[3], std::shared_ptr<const void> owner);
+
+    Layout layout() const { return layout_; }
+    size_t size() const { return size_; }
+
+    /**
+     * Replaces the vertex indices of a compact store, e.g. to reorder
+     * its triangles.
+     */
+    void setIndices(std::vector<uint32_t> indices);
+
+    /** Number of vertices of a compact store. */
+    size_t nVertices() const { return nVertices_; }
+
+    /** Vertex k of a compact store. */
+    Vector3 vertex(uint32_t k) const {
+        if(layout_ == Indexed) {
+            const float* p = &vertices_[3*size_t(k)];
+            return Vector3(p[0], p[1], p[2]);
+        }
+        const uint16_t* q = &quantized_[3*size_t(k)];
+        return Vector3(grid_.start[0] + float(base_[0] + q[0]) * grid_.step[0],
+                       grid_.start[1] + float(base_[1] + q[1]) * grid_.step[1],
+                       grid_.start[2] + float(base_[2] + q[2]) * grid_.step[2]);
+    }
+
+    /** Only for the expanded layout. */
+    void set(size_t i, const Vector3& v1, const Vector3& v2, const Vector3& v3);
+
+    /** First vertex and edges v2-v1, v3-v1 of triangle i. */
+    void get(size_t i, Vector3& v1, Vector3& e1, Vector3& e2) const {
+        if(layout_ == Expanded) {
+            v1 = Vector3(at(V1X, i), at(V1Y, i), at(V1Z, i));
+            e1 = Vector3(at(E1X, i), at(E1Y, i), at(E1Z, i));
+            e2 = Vector3(at(E2X, i), at(E2Y, i), at(E2Z, i));
+            return;
+        }
+        const uint32_t* f = &indices_[3*i];
+        v1 = vertex(f[0]);
+        e1 = vertex(f[1]) - v1;
+        e2 = vertex(f[2]) - v1;
+    }
+
+    Vector3 v1(size_t i) const { Vector3 v, e1, e2; get(i, v, e1, e2); return v; }
+    Vector3 e1(size_t i) const { Vector3 v, e1, e2; get(i, v, e1, e2); return e1; }
+    Vector3 e2(size_t i) const { Vector3 v, e1, e2; get(i, v, e1, e2); return e2; }
+
+    BBox bbox(size_t i) const;
+
+    /** see triangle_intersection */
+    bool intersect(size_t i, const Ray& ray, float* t) const {
+        Vector3 v, e1, e2;
+        get(i, v, e1, e2);
+        return triangle_intersection_edges(v, e1, e2, ray.o, ray.d, t);
+    }
+
+    /** see triangle_intersection4 */
+    int intersect4(size_t i, const __m128* O, const Vector3& D, __m128* t) const {
+        Vector3 v, e1, e2;
+        get(i, v, e1, e2);
+        return triangle_intersection4_edges(v, e1, e2, O[0], O[1], O[2], D, t);
+    }
+
+    /** Size of the storage in bytes. */
+    size_t memoryUsage() const;
+
+    /** Size the expanded layout would take, for comparison. */
+    size_t expandedMemoryUsage() const { return NArrays*size_*sizeof(float); }
+
+    /**
+     * Raw access to one of the arrays of the expanded layout, e.g. for
+     * serialization. Only stores which own their arrays can be written.
+     */
+    float* array(Array a) { return arena_.get() + a*size_; }
+    const float* array(Array a) const { return arrays_ + a*size_; }
+
+    /**
+     * Raw access to the compact layouts, e.g. for serialization: 3*size()
+     * indices and 3*nVertices() coordinates of the vertices.
+     */
+    const uint32_t* indices() const { return indices_; }
+    const float* vertices() const { return vertices_; }
+    const uint16_t* quantizedVertices() const { return quantized_; }
+    const VertexGrid& grid() const { return grid_; }
+    const int32_t* base() const { return base_; }
+
+    private:
+    float at(Array a, size_t i) const { return arrays_[a*size_ + i]; }
+
+    size_t size_;
+    Layout layout_;
+
+    // the arrays in use, which point into the owned ones below or into
+    // those of owner_
+    const float* arrays_;
+    const uint32_t* indices_;
+    const float* vertices_;
+    const uint16_t* quantized_;
+    size_t nVertices_;
+
+    std::unique_ptr<float[]> arena_;
+    std::vector<uint32_t> ownedIndices_;
+    std::vector<float> ownedVertices_;
+    std::vector<uint16_t> ownedQuantized_;
+    std::shared_ptr<const void> owner_;
+
+    VertexGrid grid_;
+    int32_t base_[3];
+};
+
+#endif /* TRIANGLESTORE_H */
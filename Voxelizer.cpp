@@ -0,0 +1,738 @@
+#include "Voxelizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "LabelSpans.h"
+#include "MajorityVote.h"
+#include "Parallel.h"
+#include "ProgressReporter.h"
+#include "Triangle.h"
+#include "TraversalStats.h"
+
+Voxelizer::Voxelizer(const Scene& scene, const Vector3& start, const Vector3& stop,
+                     const vigra::Shape3& shape)
+    : start_(start), stop_(stop), shape_(shape),
+      engine_(RayTracing), nThreads_(1), usePackets_(false), useSceneBVH_(false), progress_(0), log_(0),
+      scene_(&scene), prepared_(false)
+{
+    for(const Mesh& m : scene.meshes) {
+        meshBVHs_.push_back(m.bvh());
+    }
+}
+
+Voxelizer::Voxelizer(const std::vector<MeshBuffers>& meshes, const Vector3& start, const Vector3& stop,
+                     const vigra::Shape3& shape)
+    : start_(start), stop_(stop), shape_(shape),
+      engine_(RayTracing), nThreads_(1), usePackets_(false), useSceneBVH_(false), progress_(0), log_(0),
+      scene_(0), meshBuffers_(meshes), prepared_(false)
+{
+    for(const MeshBuffers& m : meshBuffers_) {
+        for(size_t i=0; i<3*m.nFaces; ++i) {
+            if(m.faces[i] >= m.nVertices) {
+                std::stringstream ss;
+                ss << "Voxelizer: face index " << m.faces[i] << " out of range, mesh has "
+                   << m.nVertices << " vertices";
+                throw std::runtime_error(ss.str());
+            }
+        }
+    }
+}
+
+Voxelizer::~Voxelizer()
+{
+}
+
+// Scene axis i has shape[2-i] voxels, as shape is in vigra order.
+static std::array<long int, 3> voxelCoord(const Vector3& p, const Vector3& start, const Vector3& stop,
+                                          const vigra::Shape3& shape)
+{
+    std::array<long int, 3> out;
+    for(int i=0; i<3; ++i) {
+        out[i] = std::round( (p[i]-start[i])/((float)(stop[i]-start[i]))*shape[2-i] );
+    }
+    return out;
+}
+
+Voxelizer::VoxelCoord Voxelizer::toVoxelCoord(const Vector3& p) const
+{
+    return voxelCoord(p, start_, stop_, shape_);
+}
+
+float Voxelizer::toSceneCoord(int d, float x) const
+{
+    return x/((float)shape_[2-d]) * (stop_[d]-start_[d]) + start_[d];
+}
+
+Vector3 Voxelizer::toSceneCoord(float x, float y, float z) const
+{
+    return Vector3(toSceneCoord(0, x), toSceneCoord(1, y), toSceneCoord(2, z));
+}
+
+void Voxelizer::rayRange(int d, float lo, float hi, long int& first, long int& last) const
+{
+    // Estimate the range by inverting toSceneCoord for the ray centers
+    // c + 0.5, then settle it on the rays whose start (computed exactly
+    // as in voxelize()) lies in [lo, hi]: like a BVH, rays which pass
+    // the bounding box of a triangle are not tested against it.
+    const double scale = shape_[2-d] / double(stop_[d] - start_[d]);
+    first = std::ceil((lo - start_[d]) * scale - 0.5) - 1;
+    last = std::floor((hi - start_[d]) * scale - 0.5) + 1;
+    while(first <= last && toSceneCoord(d, first + 0.5f) < lo) {
+        ++first;
+    }
+    while(last >= first && toSceneCoord(d, last + 0.5f) > hi) {
+        --last;
+    }
+}
+
+void Voxelizer::prepareTriangles(ProgressReporter& progress)
+{
+    const size_t n = scene_ ? scene_->meshes.size() : meshBuffers_.size();
+    meshTriangles_.assign(n, 0);
+    ownedTriangles_.resize(n);
+    progress.beginPhase("prepare triangles", n, "objects");
+    parallelFor(n, nThreads_, [&](size_t i, int) {
+        if(scene_ && scene_->meshes[i].bvh()) {
+            meshTriangles_[i] = &scene_->meshes[i].bvh()->triangles();
+        }
+        else if(scene_) {
+            const Mesh& m = scene_->meshes[i];
+            if(!m.faces.empty()) {
+                ownedTriangles_[i].reset(new TriangleStore(m.faces.size()));
+                for(size_t f=0; f<m.faces.size(); ++f) {
+                    ownedTriangles_[i]->set(f, m.vertices[m.faces[f][0]], m.vertices[m.faces[f][1]],
+                                            m.vertices[m.faces[f][2]]);
+                }
+            }
+        }
+        else {
+            const MeshBuffers& m = meshBuffers_[i];
+            if(m.nFaces > 0) {
+                ownedTriangles_[i].reset(new TriangleStore(m.nFaces));
+                for(size_t f=0; f<m.nFaces; ++f) {
+                    Vector3 v[3];
+                    for(int k=0; k<3; ++k) {
+                        const float* p = m.vertices + 3*size_t(m.faces[3*f+k]);
+                        v[k] = Vector3(p[0], p[1], p[2]);
+                    }
+                    ownedTriangles_[i]->set(f, v[0], v[1], v[2]);
+                }
+            }
+        }
+        if(ownedTriangles_[i]) {
+            meshTriangles_[i] = ownedTriangles_[i].get();
+        }
+        progress.add(1);
+    });
+    progress.endPhase();
+
+    footprintLo_.resize(n);
+    footprintHi_.resize(n);
+    for(size_t i=0; i<n; ++i) {
+        const TriangleStore* triangles = meshTriangles_[i];
+        if(!triangles || triangles->size() == 0) {
+            meshTriangles_[i] = 0;
+            continue;
+        }
+        BBox bb = triangles->bbox(0);
+        for(size_t t=1; t<triangles->size(); ++t) {
+            bb.expandToInclude(triangles->bbox(t));
+        }
+        footprintLo_[i] = toVoxelCoord(bb.min);
+        footprintHi_[i] = toVoxelCoord(bb.max);
+        for(int j=0; j<3; ++j) {
+            --footprintLo_[i][j];
+            ++footprintHi_[i][j];
+        }
+    }
+}
+
+void Voxelizer::prepare()
+{
+    if(prepared_) {
+        return;
+    }
+    std::ostream nullOut(0);
+    ProgressReporter silent(nullOut);
+    ProgressReporter& progress = progress_ ? *progress_ : silent;
+
+    if(engine_ == Rasterization) {
+        prepareTriangles(progress);
+        prepared_ = true;
+        return;
+    }
+
+    if(!meshBuffers_.empty()) {
+        // build the BVHs straight from the caller's buffers, without
+        // copying them into Meshes first
+        ownedBVHs_.resize(meshBuffers_.size());
+        auto buildBVH = [&](size_t i, int threads) {
+            const MeshBuffers& m = meshBuffers_[i];
+            std::vector<Triangle> triangles;
+            triangles.reserve(m.nFaces);
+            for(size_t f=0; f<m.nFaces; ++f) {
+                const float* v[3];
+                for(int k=0; k<3; ++k) {
+                    v[k] = m.vertices + 3*size_t(m.faces[3*f+k]);
+                }
+                triangles.push_back(Triangle(Vector3(v[0][0], v[0][1], v[0][2]),
+                                             Vector3(v[1][0], v[1][1], v[1][2]),
+                                             Vector3(v[2][0], v[2][1], v[2][2]), i+1));
+            }
+            if(!triangles.empty()) {
+                ownedBVHs_[i].reset(new MeshBVH(std::move(triangles), 4, threads));
+            }
+            progress.add(1);
+        };
+        // as in surface2volume: large meshes one after the other, each
+        // using all threads, all other meshes concurrently
+        const size_t largeMeshFaces = 1 << 16;
+        std::vector<size_t> smallMeshes;
+        progress.beginPhase("build BVH", meshBuffers_.size(), "objects");
+        for(size_t i=0; i<meshBuffers_.size(); ++i) {
+            if(meshBuffers_[i].nFaces >= largeMeshFaces) {
+                buildBVH(i, nThreads_);
+            }
+            else {
+                smallMeshes.push_back(i);
+            }
+        }
+        parallelFor(smallMeshes.size(), nThreads_, [&](size_t k, int) {
+            buildBVH(smallMeshes[k], 1);
+        });
+        progress.endPhase();
+        for(const std::unique_ptr<MeshBVH>& bvh : ownedBVHs_) {
+            meshBVHs_.push_back(bvh.get());
+        }
+    }
+
+    footprintLo_.resize(meshBVHs_.size());
+    footprintHi_.resize(meshBVHs_.size());
+    for(size_t i=0; i<meshBVHs_.size(); ++i) {
+        if(!meshBVHs_[i] || meshBVHs_[i]->nodes().empty()) {
+            continue;
+        }
+        const BBox& bb = meshBVHs_[i]->nodes()[0].bbox;
+        footprintLo_[i] = toVoxelCoord(bb.min);
+        footprintHi_[i] = toVoxelCoord(bb.max);
+        for(int j=0; j<3; ++j) {
+            --footprintLo_[i][j];
+            ++footprintHi_[i][j];
+        }
+    }
+
+    // With the scene BVH, every ray is traced once through all objects.
+    // Its hits are grouped by object and filled in label order, which
+    // gives the same result as one pass per object.
+    if(useSceneBVH_) {
+        progress.beginPhase("build scene BVH", 1, "trees");
+        sceneBVH_.reset(new SceneBVH(meshBVHs_));
+        progress.add(1);
+        progress.endPhase();
+    }
+    prepared_ = true;
+}
+
+BBox Voxelizer::regionBounds(const Vector3& start, const Vector3& stop, const vigra::Shape3& shape,
+                             const vigra::Shape3& roiBegin, const vigra::Shape3& roiEnd)
+{
+    // two voxels more than the footprint margin, against rounding
+    Vector3 lo, hi;
+    for(int i=0; i<3; ++i) {
+        const float voxelSize = (stop[i]-start[i]) / float(shape[2-i]);
+        lo[i] = start[i] + (roiBegin[2-i] - 2) * voxelSize;
+        hi[i] = start[i] + (roiEnd[2-i] + 2) * voxelSize;
+    }
+    return BBox(lo, hi);
+}
+
+bool Voxelizer::affectedRegion(const BBox& bbox, const Vector3& start, const Vector3& stop,
+                               const vigra::Shape3& shape, vigra::Shape3& begin, vigra::Shape3& end)
+{
+    // the footprint (see prepare()), in vigra order
+    const VoxelCoord lo = voxelCoord(bbox.min, start, stop, shape);
+    const VoxelCoord hi = voxelCoord(bbox.max, start, stop, shape);
+    bool empty = false;
+    for(int d=0; d<3; ++d) {
+        begin[2-d] = std::max<long int>(lo[d] - 1, 0);
+        end[2-d] = std::min<long int>(hi[d] + 2, shape[2-d]);
+        empty = empty || begin[2-d] >= end[2-d];
+    }
+    return !empty;
+}
+
+template<class T>
+void Voxelizer::voxelize(Labels<T> labels)
+{
+    voxelize(labels, vigra::Shape3(0, 0, 0), shape_);
+}
+
+template<class T>
+void Voxelizer::voxelize(Labels<T> labels, const vigra::Shape3& roiBegin, const vigra::Shape3& roiEnd)
+{
+    if(nObjects() > std::numeric_limits<T>::max()) {
+        std::stringstream ss;
+        ss << "Voxelizer: " << nObjects() << " objects do not fit into labels of type "
+           << labelTypeName(LabelTypeOf<T>::value);
+        throw std::runtime_error(ss.str());
+    }
+    for(int i=0; i<3; ++i) {
+        if(roiBegin[i] < 0 || roiBegin[i] >= roiEnd[i] || roiEnd[i] > shape_[i]) {
+            throw std::runtime_error("Voxelizer: region of interest outside of the volume");
+        }
+    }
+    if(labels.shape() != roiEnd - roiBegin) {
+        throw std::runtime_error("Voxelizer: labels do not match the region of interest");
+    }
+    prepare();
+
+    std::ostream nullOut(0);
+    ProgressReporter silent(nullOut);
+    ProgressReporter& progress = progress_ ? *progress_ : silent;
+    std::ostream& log = log_ ? *log_ : nullOut;
+
+    const int nThreads = nThreads_;
+    const SceneBVH* sceneBVH = useSceneBVH_ ? sceneBVH_.get() : 0;
+
+    // The region of interest is [lo[d], hi[d]) along coord[d], which is
+    // axis 2-d of labels. Only the rays through it are traced, and only
+    // their voxels inside it are filled.
+    vigra::MultiArrayIndex lo[3], hi[3];
+    for(int d=0; d<3; ++d) {
+        lo[d] = roiBegin[2-d];
+        hi[d] = roiEnd[2-d];
+    }
+
+    // The rays of a tile first collect their labels as spans (see
+    // RayLabelSpans), which are expanded once the whole tile is traced:
+    // those along axis 0 directly into the slab, those along axes 1 and 2
+    // into a per thread buffer, which is then folded into the slab by
+    // MajorityVote.
+    typedef vigra::MultiArray<3, T> V;
+    std::vector<V> tileLabels(nThreads);
+
+    // Returns the ray along rayAxis through the voxel column at coord.
+    auto makeRay = [&](int rayAxis, const vigra::TinyVector<vigra::MultiArrayIndex, 3>& coord) -> Ray
+    {
+        float c[3] = {coord[0]+0.5f, coord[1]+0.5f, coord[2]+0.5f};
+        c[rayAxis] = -10.0f;
+
+        const Vector3 normal(1 ? rayAxis==0 : 0,
+                             1 ? rayAxis==1 : 0,
+                             1 ? rayAxis==2 : 0);
+
+        return Ray(toSceneCoord(c[0], c[1], c[2]), normal);
+    };
+
+    // Given all hits of ray (see makeRay) with a mesh, paints the voxels
+    // of the column at coord which lie inside the mesh with label
+    // (and inside the region of interest) into spans.
+    auto fillRay = [&](RayLabelSpans& spans, uint32_t label, int rayAxis,
+                       vigra::TinyVector<vigra::MultiArrayIndex, 3> coord,
+                       const Ray& ray, const RayHit* hits, const RayHit* hitsEnd)
+    {
+        bool inside = false;
+
+        VoxelCoord prevVoxelCoor = {coord[0], coord[1], coord[2]};
+        prevVoxelCoor[rayAxis] = -10.0f;
+
+        for(const RayHit* h = hits; h != hitsEnd; ++h) {
+            VoxelCoord currVoxelCoor = toVoxelCoord(ray.o + ray.d * h->t);
+            if(inside) {
+                // fill (prev, curr], clipped to the region of interest
+                const long int first = std::max<long int>(prevVoxelCoor[rayAxis]+1, lo[rayAxis]);
+                const long int last  = std::min<long int>(currVoxelCoor[rayAxis], hi[rayAxis]-1);
+                spans.paint(first, last+1, label);
+            }
+            prevVoxelCoor = currVoxelCoor;
+            inside = !inside;
+        }
+    };
+
+    // Fills the column at coord with the hits of all objects (see SceneBVH).
+    auto fillSceneRay = [&](RayLabelSpans& spans, int rayAxis,
+                            const vigra::TinyVector<vigra::MultiArrayIndex, 3>& coord,
+                            const Ray& ray, const SceneHits& hits)
+    {
+        for(const SceneHitRange& r : hits.ranges) {
+            fillRay(spans, r.mesh + 1, rayAxis, coord, ray,
+                    hits.hits.data() + r.begin, hits.hits.data() + r.end);
+        }
+    };
+
+    // The (a,b) ray grid of each ray axis is split into square tiles which
+    // are handed out to the worker threads. Within a tile, the objects are
+    // traced in the same order as in a serial run, so that later objects
+    // overwrite earlier ones exactly as before and the result does not
+    // depend on the number of threads.
+    const vigra::MultiArrayIndex tileSize = 32;
+
+    labels.init(0);
+    MajorityVote<T> vote(labels);
+
+    for(int rayAxis = 0; rayAxis<3; ++rayAxis) {
+        int otherAxes[2];
+        {
+            int j = 0;
+            for(int i=0; i<3; ++i) {
+                if(i!=rayAxis) {
+                    otherAxes[j] = i;
+                    ++j;
+                }
+            }
+        }
+
+        log << "*** " << (engine_ == Rasterization ? "rasterizing" : "tracing") << " objects (ray axis = "
+            << rayAxis << ")" << std::endl;
+
+        // only the rays starting in the region of interest cross it
+        const vigra::MultiArrayIndex rangeA0 = lo[otherAxes[0]], rangeA1 = hi[otherAxes[0]];
+        const vigra::MultiArrayIndex rangeB0 = lo[otherAxes[1]], rangeB1 = hi[otherAxes[1]];
+        const vigra::MultiArrayIndex nTiles0 = (rangeA1 - rangeA0 + tileSize - 1) / tileSize;
+        const vigra::MultiArrayIndex nTiles1 = (rangeB1 - rangeB0 + tileSize - 1) / tileSize;
+        const size_t nTilesTotal = nTiles0*nTiles1;
+        // per thread scratch space for the hits of up to four rays
+        std::vector<std::array<std::vector<RayHit>, 4> > hitBuffers(nThreads);
+        std::vector<std::array<SceneHits, 4> > sceneHitBuffers(sceneBVH ? nThreads : 0);
+        // per thread spans of the rays of a tile
+        std::vector<std::vector<RayLabelSpans> > tileSpans(nThreads, std::vector<RayLabelSpans>(tileSize*tileSize));
+
+        // With Rasterization, the triangles are first projected onto the
+        // ray grid: the rays [a0, a1] x [b0, b1] which a triangle may cross
+        // (clipped to the region of interest) are stored as a RayRect.
+        // Each triangle is then sorted into the tiles it overlaps: the
+        // triangles of tile k are binEntries[binBegin[k], binBegin[k+1]),
+        // in label order.
+        struct RayRect {
+            int32_t a0, a1, b0, b1;
+            uint32_t object, triangle;
+        };
+        std::vector<RayRect> rects;
+        std::vector<size_t> binBegin;
+        std::vector<uint32_t> binEntries;
+        // per thread crossings of the rays of a tile with the current
+        // object, and the rays which have any
+        std::vector<std::vector<std::vector<RayHit> > > rayHits;
+        std::vector<std::vector<size_t> > crossedRays(nThreads);
+        if(engine_ == Rasterization) {
+            progress.beginPhase("rasterize axis " + std::to_string(rayAxis), 0, "triangles");
+            for(size_t i=0; i<meshTriangles_.size(); ++i) {
+                if(!meshTriangles_[i]) {
+                    continue;
+                }
+                if(footprintHi_[i][rayAxis] < lo[rayAxis] || footprintLo_[i][rayAxis] >= hi[rayAxis]) {
+                    continue;
+                }
+                const TriangleStore& triangles = *meshTriangles_[i];
+                for(size_t t=0; t<triangles.size(); ++t) {
+                    const BBox bb = triangles.bbox(t);
+                    long int a0, a1, b0, b1;
+                    rayRange(otherAxes[0], bb.min[otherAxes[0]], bb.max[otherAxes[0]], a0, a1);
+                    rayRange(otherAxes[1], bb.min[otherAxes[1]], bb.max[otherAxes[1]], b0, b1);
+                    a0 = std::max<long int>(a0, rangeA0);
+                    a1 = std::min<long int>(a1, rangeA1 - 1);
+                    b0 = std::max<long int>(b0, rangeB0);
+                    b1 = std::min<long int>(b1, rangeB1 - 1);
+                    if(a0 <= a1 && b0 <= b1) {
+                        const RayRect r = {int32_t(a0), int32_t(a1), int32_t(b0), int32_t(b1), uint32_t(i), uint32_t(t)};
+                        rects.push_back(r);
+                    }
+                }
+            }
+            // count the triangles of each tile, then fill them in
+            binBegin.assign(nTilesTotal + 1, 0);
+            std::vector<size_t> binEnd;
+            for(int pass=0; pass<2; ++pass) {
+                for(size_t e=0; e<rects.size(); ++e) {
+                    const RayRect& r = rects[e];
+                    for(long int ta = (r.a0 - rangeA0) / tileSize; ta <= (r.a1 - rangeA0) / tileSize; ++ta) {
+                        for(long int tb = (r.b0 - rangeB0) / tileSize; tb <= (r.b1 - rangeB0) / tileSize; ++tb) {
+                            const size_t k = ta*nTiles1 + tb;
+                            if(pass == 0) {
+                                ++binBegin[k+1];
+                            }
+                            else {
+                                binEntries[binEnd[k]++] = uint32_t(e);
+                            }
+                        }
+                    }
+                }
+                if(pass == 0) {
+                    std::partial_sum(binBegin.begin(), binBegin.end(), binBegin.begin());
+                    binEntries.resize(binBegin.back());
+                    binEnd.assign(binBegin.begin(), binBegin.end() - 1);
+                }
+            }
+            progress.add(rects.size());
+            progress.endPhase();
+            rayHits.assign(nThreads, std::vector<std::vector<RayHit> >(tileSize*tileSize));
+        }
+
+        std::stringstream phaseName;
+        phaseName << (engine_ == Rasterization ? "fill axis " : "trace axis ") << rayAxis;
+        progress.beginPhase(phaseName.str(), nTilesTotal, "tiles");
+        parallelFor(nTilesTotal, nThreads, [&](size_t tile, int threadIndex) {
+            const vigra::MultiArrayIndex tileA0 = rangeA0 + (tile / nTiles1) * tileSize;
+            const vigra::MultiArrayIndex tileB0 = rangeB0 + (tile % nTiles1) * tileSize;
+            const vigra::MultiArrayIndex tileA1 = std::min(tileA0 + tileSize, rangeA1);
+            const vigra::MultiArrayIndex tileB1 = std::min(tileB0 + tileSize, rangeB1);
+
+            std::vector<RayLabelSpans>& spans = tileSpans[threadIndex];
+            for(RayLabelSpans& s : spans) {
+                s.clear();
+            }
+            auto spansAt = [&](const vigra::TinyVector<vigra::MultiArrayIndex, 3>& coord) -> RayLabelSpans& {
+                return spans[(coord[otherAxes[0]] - tileA0)*tileSize + coord[otherAxes[1]] - tileB0];
+            };
+            // traversals and hits of this tile
+            uint64_t nRays = 0;
+            uint64_t nHits = 0;
+
+            if(engine_ == Rasterization) {
+                std::vector<std::vector<RayHit> >& hits = rayHits[threadIndex];
+                std::vector<size_t>& crossed = crossedRays[threadIndex];
+                vigra::TinyVector<vigra::MultiArrayIndex, 3> coord;
+
+                // tests and crossings of the current object
+                TraversalCounters counted;
+
+                // sorts the crossings of each ray with object i and fills
+                // the voxels inside by parity
+                auto fillObject = [&](uint32_t i) {
+                    for(size_t r : crossed) {
+                        coord[otherAxes[0]] = tileA0 + r / tileSize;
+                        coord[otherAxes[1]] = tileB0 + r % tileSize;
+                        const size_t nFound = hits[r].size();
+                        TRAVERSAL_COUNT(counted.hits, nFound);
+                        MeshBVH::sortAndMergeHits(hits[r]);
+                        TRAVERSAL_COUNT(counted.mergedHits, nFound - hits[r].size());
+                        ++nRays;
+                        nHits += hits[r].size();
+                        fillRay(spans[r], i + 1, rayAxis, coord, makeRay(rayAxis, coord),
+                                hits[r].data(), hits[r].data() + hits[r].size());
+                        hits[r].clear();
+                    }
+                    TRAVERSAL_COUNT(counted.rays, crossed.size());
+                    TRAVERSAL_TARGET(i, rayAxis);
+                    TRAVERSAL_ADD(counted);
+                    counted = TraversalCounters();
+                    crossed.clear();
+                };
+
+                const size_t eBegin = binBegin[tile], eEnd = binBegin[tile+1];
+                for(size_t e = eBegin; e < eEnd; ++e) {
+                    const RayRect& rect = rects[binEntries[e]];
+                    if(e > eBegin && rect.object != rects[binEntries[e-1]].object) {
+                        fillObject(rects[binEntries[e-1]].object);
+                    }
+                    // the rays of this tile covered by the triangle, decided
+                    // by the same test as when tracing them
+                    const vigra::MultiArrayIndex a0 = std::max<vigra::MultiArrayIndex>(rect.a0, tileA0);
+                    const vigra::MultiArrayIndex a1 = std::min<vigra::MultiArrayIndex>(rect.a1, tileA1 - 1);
+                    const vigra::MultiArrayIndex b0 = std::max<vigra::MultiArrayIndex>(rect.b0, tileB0);
+                    const vigra::MultiArrayIndex b1 = std::min<vigra::MultiArrayIndex>(rect.b1, tileB1 - 1);
+                    for(coord[otherAxes[0]] = a0; coord[otherAxes[0]] <= a1; ++coord[otherAxes[0]]) {
+                        for(coord[otherAxes[1]] = b0; coord[otherAxes[1]] <= b1; ++coord[otherAxes[1]]) {
+                            RayHit h;
+                            TRAVERSAL_COUNT(counted.triangleTests, 1);
+                            if(!meshTriangles_[rect.object]->intersect(rect.triangle, makeRay(rayAxis, coord), &h.t)) {
+                                continue;
+                            }
+                            h.prim = rect.triangle;
+                            const size_t r = (coord[otherAxes[0]] - tileA0)*tileSize + coord[otherAxes[1]] - tileB0;
+                            if(hits[r].empty()) {
+                                crossed.push_back(r);
+                            }
+                            hits[r].push_back(h);
+                        }
+                    }
+                }
+                if(eBegin < eEnd) {
+                    fillObject(rects[binEntries[eEnd-1]].object);
+                }
+            }
+            else if(sceneBVH) {
+                std::vector<RayHit>* hits = hitBuffers[threadIndex].data();
+                SceneHits* sceneHits = sceneHitBuffers[threadIndex].data();
+                // the SceneBVH attributes its work to the meshes
+                TRAVERSAL_TARGET(0, rayAxis);
+
+                vigra::TinyVector<vigra::MultiArrayIndex, 3> coord;
+                for(coord[otherAxes[0]] = tileA0; coord[otherAxes[0]] < tileA1; ++coord[otherAxes[0]]) {
+                if(usePackets_) {
+                    for(vigra::MultiArrayIndex b = tileB0; b < tileB1; b += 4) {
+                        AxisRayPacket4 packet;
+                        packet.axis = rayAxis;
+                        packet.nRays = std::min<vigra::MultiArrayIndex>(4, tileB1 - b);
+                        for(int i=0; i<packet.nRays; ++i) {
+                            coord[otherAxes[1]] = b + i;
+                            const Ray ray = makeRay(rayAxis, coord);
+                            packet.start = ray.o[rayAxis];
+                            packet.u[i] = ray.o[otherAxes[0]];
+                            packet.v[i] = ray.o[otherAxes[1]];
+                        }
+                        sceneBVH->getAllIntersections4(packet, sceneHits, hits);
+                        nRays += packet.nRays;
+                        for(int i=0; i<packet.nRays; ++i) {
+                            nHits += sceneHits[i].hits.size();
+                            coord[otherAxes[1]] = b + i;
+                            fillSceneRay(spansAt(coord), rayAxis, coord, makeRay(rayAxis, coord), sceneHits[i]);
+                        }
+                    }
+                }
+                else {
+                    for(coord[otherAxes[1]] = tileB0; coord[otherAxes[1]] < tileB1; ++coord[otherAxes[1]]) {
+                        const Ray ray = makeRay(rayAxis, coord);
+                        sceneBVH->getAllIntersections(ray, sceneHits[0], hits[0]);
+                        ++nRays;
+                        nHits += sceneHits[0].hits.size();
+                        fillSceneRay(spansAt(coord), rayAxis, coord, ray, sceneHits[0]);
+                    }
+                }
+                }
+            }
+            else {
+                for(uint32_t currentLabel = 0; currentLabel < meshBVHs_.size(); ++currentLabel) {
+                    if(!meshBVHs_[currentLabel]) {
+                        continue;
+                    }
+                    if(footprintHi_[currentLabel][rayAxis] < lo[rayAxis] || footprintLo_[currentLabel][rayAxis] >= hi[rayAxis]) {
+                        continue;
+                    }
+                    const MeshBVH& bvh = *meshBVHs_[currentLabel];
+                    TRAVERSAL_TARGET(currentLabel, rayAxis);
+
+                    // only shoot the rays of this tile which pass the object's footprint
+                    const vigra::MultiArrayIndex a0 = std::max<vigra::MultiArrayIndex>(tileA0, footprintLo_[currentLabel][otherAxes[0]]);
+                    const vigra::MultiArrayIndex b0 = std::max<vigra::MultiArrayIndex>(tileB0, footprintLo_[currentLabel][otherAxes[1]]);
+                    const vigra::MultiArrayIndex a1 = std::min<vigra::MultiArrayIndex>(tileA1, footprintHi_[currentLabel][otherAxes[0]]+1);
+                    const vigra::MultiArrayIndex b1 = std::min<vigra::MultiArrayIndex>(tileB1, footprintHi_[currentLabel][otherAxes[1]]+1);
+                    if(a0 >= a1 || b0 >= b1) {
+                        continue;
+                    }
+
+                    std::vector<RayHit>* hits = hitBuffers[threadIndex].data();
+
+                    vigra::TinyVector<vigra::MultiArrayIndex, 3> coord;
+                    for(coord[otherAxes[0]] = a0; coord[otherAxes[0]] < a1; ++coord[otherAxes[0]]) {
+                    if(usePackets_) {
+                        // neighbouring rays along otherAxes[1], four at a time
+                        for(vigra::MultiArrayIndex b = b0; b < b1; b += 4) {
+                            AxisRayPacket4 packet;
+                            packet.axis = rayAxis;
+                            packet.nRays = std::min<vigra::MultiArrayIndex>(4, b1 - b);
+                            for(int i=0; i<packet.nRays; ++i) {
+                                coord[otherAxes[1]] = b + i;
+                                const Ray ray = makeRay(rayAxis, coord);
+                                packet.start = ray.o[rayAxis];
+                                packet.u[i] = ray.o[otherAxes[0]];
+                                packet.v[i] = ray.o[otherAxes[1]];
+                            }
+                            bvh.getAllIntersections4(packet, hits);
+                            nRays += packet.nRays;
+                            for(int i=0; i<packet.nRays; ++i) {
+                                nHits += hits[i].size();
+                                coord[otherAxes[1]] = b + i;
+                                fillRay(spansAt(coord), currentLabel + 1, rayAxis, coord, makeRay(rayAxis, coord),
+                                        hits[i].data(), hits[i].data() + hits[i].size());
+                            }
+                        }
+                    }
+                    else {
+                        for(coord[otherAxes[1]] = b0; coord[otherAxes[1]] < b1; ++coord[otherAxes[1]]) {
+                            const Ray ray = makeRay(rayAxis, coord);
+                            bvh.getAllIntersections(ray, hits[0]);
+                            ++nRays;
+                            nHits += hits[0].size();
+                            fillRay(spansAt(coord), currentLabel + 1, rayAxis, coord, ray,
+                                    hits[0].data(), hits[0].data() + hits[0].size());
+                        }
+                    }
+                    }
+                } /* iteration over all objects in the scene */
+            }
+
+            vigra::TinyVector<vigra::MultiArrayIndex, 3> coord;
+            if(rayAxis == 0) {
+                // These rays cross the planes of labels, expand them
+                // plane by plane, so that neighbouring rays write
+                // neighbouring voxels.
+                int32_t tBegin = hi[0], tEnd = lo[0];
+                for(const RayLabelSpans& s : spans) {
+                    if(!s.empty()) {
+                        tBegin = std::min(tBegin, s.spans().front().begin);
+                        tEnd = std::max(tEnd, s.spans().back().end);
+                    }
+                }
+                std::vector<size_t> cursor(spans.size(), 0);
+                for(coord[0] = tBegin; coord[0] < tEnd; ++coord[0]) {
+                    for(coord[1] = tileA0; coord[1] < tileA1; ++coord[1]) {
+                        for(coord[2] = tileB0; coord[2] < tileB1; ++coord[2]) {
+                            const size_t r = (coord[1] - tileA0)*tileSize + coord[2] - tileB0;
+                            const std::vector<LabelSpan>& s = spans[r].spans();
+                            size_t& k = cursor[r];
+                            while(k < s.size() && s[k].end <= coord[0]) {
+                                ++k;
+                            }
+                            if(k < s.size() && s[k].begin <= coord[0]) {
+                                labels(coord[2] - lo[2], coord[1] - lo[1], coord[0] - lo[0]) = static_cast<T>(s[k].label);
+                            }
+                        }
+                    }
+                }
+            }
+            else {
+                V& block = tileLabels[threadIndex];
+                vigra::Shape3 blockShape;
+                blockShape[2-rayAxis] = hi[rayAxis] - lo[rayAxis];
+                blockShape[2-otherAxes[0]] = tileA1 - tileA0;
+                blockShape[2-otherAxes[1]] = tileB1 - tileB0;
+                block.reshape(blockShape);
+
+                coord[rayAxis] = 0;
+                for(coord[otherAxes[0]] = tileA0; coord[otherAxes[0]] < tileA1; ++coord[otherAxes[0]]) {
+                    for(coord[otherAxes[1]] = tileB0; coord[otherAxes[1]] < tileB1; ++coord[otherAxes[1]]) {
+                        vigra::Shape3 p;
+                        p[2-otherAxes[0]] = coord[otherAxes[0]] - tileA0;
+                        p[2-otherAxes[1]] = coord[otherAxes[1]] - tileB0;
+                        spansAt(coord).fill(&block[p], lo[rayAxis], block.stride(2-rayAxis));
+                    }
+                }
+
+                vigra::Shape3 offset;
+                offset[2-otherAxes[0]] = tileA0 - lo[otherAxes[0]];
+                offset[2-otherAxes[1]] = tileB0 - lo[otherAxes[1]];
+                if(rayAxis == 1) {
+                    vote.addSecond(block, offset);
+                }
+                else {
+                    vote.addThird(block, offset);
+                }
+            }
+
+            progress.add(1, nRays, nHits);
+        });
+        progress.endPhase();
+        log << std::endl;
+
+        if(rayAxis == 1) {
+            progress.beginPhase("vote", 0, "undecided voxels");
+            vote.finishSecond();
+            progress.add(vote.nUndecided());
+            progress.endPhase();
+            log << std::endl;
+        }
+    } /* ray axis iteration */
+}
+
+template void Voxelizer::voxelize(Labels<uint8_t>);
+template void Voxelizer::voxelize(Labels<uint16_t>);
+template void Voxelizer::voxelize(Labels<uint32_t>);
+template void Voxelizer::voxelize(Labels<uint8_t>, const vigra::Shape3&, const vigra::Shape3&);
+template void Voxelizer::voxelize(Labels<uint16_t>, const vigra::Shape3&, const vigra::Shape3&);
+template void Voxelizer::voxelize(Labels<uint32_t>, const vigra::Shape3&, const vigra::Shape3&);
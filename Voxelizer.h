@@ -0,0 +1,201 @@
+#ifndef VOXELIZER_H
+#define VOXELIZER_H
+
+#include <array>
+#include <memory>
+#include <ostream>
+#include <vector>
+#include <stdint.h>
+
+#include <vigra/multi_array.hxx>
+
+#include "fastbvh/Vector3.h"
+
+#include "LabelType.h"
+#include "MeshBVH.h"
+#include "Scene.h"
+#include "SceneBVH.h"
+
+class ProgressReporter;
+
+/**
+ * A triangle mesh in buffers owned by the caller: nVertices vertices of
+ * three floats (x, y, z) each, and nFaces faces of three 0-based vertex
+ * indices each.
+ */
+struct MeshBuffers {
+    const float* vertices;
+    size_t nVertices;
+    const uint32_t* faces;
+    size_t nFaces;
+};
+
+/**
+ * Renders a set of meshes into a label volume, in process.
+ *
+ * The volume of the given shape covers the scene box [start, stop).
+ * Object i (in the order given) is assigned label i+1, voxels outside
+ * of all objects label 0. Rays are shot through the voxel centers along
+ * all three axes; a voxel gets the label that at least two of them
+ * agree on (see MajorityVote). Where objects overlap, later ones win.
+ *
+ * As in the output of surface2volume, labels(i, j, k) (first index
+ * fastest in memory) is the voxel with index k along the scene's x
+ * axis, j along y and i along z; shape is given in the same order.
+ * The volume can also be voxelized block by block, e.g. in slabs or
+ * in separate processes (see regionBounds()). The result does not
+ * depend on the number of threads, on packets or the scene BVH, nor on
+ * how the volume is split into blocks.
+ *
+ * There are two engines (see setEngine()), which give the same result:
+ * by default, every ray is traced through the BVH of each object. With
+ * Rasterization, no BVHs are needed; instead, each triangle is
+ * rasterized onto the grid of rays of each axis, recording where it
+ * crosses the rays it covers, whose crossings are then sorted and
+ * parity filled. Its cost scales with the number of triangles and of
+ * covered rays rather than with the number of rays times the depth of
+ * the BVHs, which pays off for many small, dense meshes.
+ *
+ * The labels can be of any of the types in LabelType.h which holds
+ * the number of objects; labelType() is the narrowest one.
+ *
+ * BVHs are built (or, for a Scene, taken from its meshes) on the first
+ * call to voxelize(). Calls to voxelize() must not overlap.
+ */
+class Voxelizer {
+    public:
+    template<class T>
+    using Labels = vigra::MultiArrayView<3, T, vigra::UnstridedArrayTag>;
+
+    enum Engine {
+        RayTracing,   /**< trace the rays through per-object BVHs */
+        Rasterization /**< rasterize the triangles onto the rays, without BVHs */
+    };
+
+    /**
+     * Voxelizes the meshes of scene, whose BVHs must have been built
+     * (see Mesh::buildBVH); meshes without one are skipped. With
+     * Rasterization, the vertices and faces of meshes without a BVH are
+     * used instead.
+     * scene must outlive the voxelizer.
+     */
+    Voxelizer(const Scene& scene, const Vector3& start, const Vector3& stop,
+              const vigra::Shape3& shape);
+
+    /**
+     * Voxelizes meshes given as caller-owned buffers, which are not
+     * copied and must outlive the voxelizer. Their BVHs are built
+     * directly from them.
+     */
+    Voxelizer(const std::vector<MeshBuffers>& meshes, const Vector3& start, const Vector3& stop,
+              const vigra::Shape3& shape);
+
+    ~Voxelizer();
+
+    void setNumThreads(int nThreads) { nThreads_ = nThreads; }
+
+    /** RayTracing (the default) or Rasterization. */
+    void setEngine(Engine engine) { engine_ = engine; }
+
+    /** Trace four neighbouring rays at once (see MeshBVH::getAllIntersections4). */
+    void setPackets(bool usePackets) { usePackets_ = usePackets; }
+
+    /**
+     * Trace all objects in a single sweep through a SceneBVH.
+     * Packets and the scene BVH only apply to the RayTracing engine.
+     */
+    void setSceneBVH(bool useSceneBVH) { useSceneBVH_ = useSceneBVH; }
+
+    /** Reports the phases to progress and their headings to log (both may be null). */
+    void setProgress(ProgressReporter* progress) { progress_ = progress; }
+    void setLog(std::ostream* log) { log_ = log; }
+
+    const vigra::Shape3& shape() const { return shape_; }
+
+    /** Number of objects, i.e. the largest label. */
+    size_t nObjects() const { return scene_ ? scene_->meshes.size() : meshBuffers_.size(); }
+
+    /** The narrowest label type holding all labels. */
+    LabelType labelType() const { return labelTypeFor(nObjects()); }
+
+    /**
+     * Fills labels, a volume of shape() which may be a view of a caller
+     * provided buffer. Throws std::runtime_error if T cannot hold all
+     * labels.
+     */
+    template<class T>
+    void voxelize(Labels<T> labels);
+
+    /**
+     * Fills the region of interest [roiBegin, roiEnd) of the volume;
+     * labels has shape roiEnd - roiBegin. Only the rays through the
+     * region are traced.
+     */
+    template<class T>
+    void voxelize(Labels<T> labels, const vigra::Shape3& roiBegin, const vigra::Shape3& roiEnd);
+
+    /**
+     * Returns a box in scene coordinates which contains every object
+     * that can affect the voxels [roiBegin, roiEnd) of a volume of shape
+     * covering [start, stop). Objects outside of it may be left out
+     * (e.g. empty, see OBJReader::setBounds) when only voxelizing this
+     * region, without changing its labels.
+     */
+    static BBox regionBounds(const Vector3& start, const Vector3& stop, const vigra::Shape3& shape,
+                             const vigra::Shape3& roiBegin, const vigra::Shape3& roiEnd);
+
+    /**
+     * The opposite of regionBounds(): computes the block [begin, end) of
+     * voxels, clipped to the volume, whose labels an object inside bbox
+     * can affect. Returns false if the block is empty.
+     */
+    static bool affectedRegion(const BBox& bbox, const Vector3& start, const Vector3& stop,
+                               const vigra::Shape3& shape, vigra::Shape3& begin, vigra::Shape3& end);
+
+    private:
+    typedef std::array<long int, 3> VoxelCoord;
+
+    void prepare();
+
+    VoxelCoord toVoxelCoord(const Vector3& p) const;
+    Vector3 toSceneCoord(float x, float y, float z) const;
+    float toSceneCoord(int d, float x) const;
+
+    Vector3 start_;
+    Vector3 stop_;
+    vigra::Shape3 shape_;
+
+    Engine engine_;
+    int nThreads_;
+    bool usePackets_;
+    bool useSceneBVH_;
+    ProgressReporter* progress_;
+    std::ostream* log_;
+
+    void prepareTriangles(ProgressReporter& progress);
+
+    // The range [first, last] of rays along coordinate axis d whose
+    // centers lie in [lo, hi] (in scene coordinates).
+    void rayRange(int d, float lo, float hi, long int& first, long int& last) const;
+
+    const Scene* scene_;
+
+    // the BVH of each object (null for empty ones), in label order
+    std::vector<const MeshBVH*> meshBVHs_;
+    std::vector<MeshBuffers> meshBuffers_;
+    std::vector<std::unique_ptr<MeshBVH> > ownedBVHs_;
+    // with Rasterization: the triangles of each object (null for empty
+    // ones), those of its BVH if it has one
+    std::vector<const TriangleStore*> meshTriangles_;
+    std::vector<std::unique_ptr<TriangleStore> > ownedTriangles_;
+    bool prepared_;
+
+    // Voxel range [lo, hi] covered by each object's bounding box, plus a
+    // margin of one voxel. Rays outside of it cannot hit the object.
+    std::vector<VoxelCoord> footprintLo_;
+    std::vector<VoxelCoord> footprintHi_;
+
+    std::unique_ptr<SceneBVH> sceneBVH_;
+};
+
+#endif /* VOXELIZER_H */
@@ -0,0 +1,141 @@
+#include "ZarrWriter.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void makeDirectory(const std::string& path)
+{
+    if(::mkdir(path.c_str(), 0777) != 0 && errno != EEXIST) {
+        throw std::runtime_error("could not create directory '" + path + "': " + std::strerror(errno));
+    }
+}
+
+// Removes the files (chunks and metadata) of the array in path, if any.
+static void removeArrayFiles(const std::string& path)
+{
+    DIR* dir = ::opendir(path.c_str());
+    if(!dir) {
+        return;
+    }
+    std::vector<std::string> files;
+    while(const struct dirent* entry = ::readdir(dir)) {
+        const std::string name = entry->d_name;
+        struct stat st;
+        if(name != "." && name != ".." && ::stat((path + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            files.push_back(path + "/" + name);
+        }
+    }
+    ::closedir(dir);
+    for(const std::string& file : files) {
+        if(std::remove(file.c_str()) != 0 && errno != ENOENT) {
+            throw std::runtime_error("could not remove '" + file + "': " + std::strerror(errno));
+        }
+    }
+}
+
+static void writeFile(const std::string& path, const char* data, size_t size)
+{
+    std::ofstream o(path.c_str(), std::ios::binary);
+    o.write(data, size);
+    o.close();
+    if(!o) {
+        throw std::runtime_error("could not write '" + path + "'");
+    }
+}
+
+// Writes the metadata in path through a temporary file, so that runs of
+// several tiles at once never see it truncated (or truncate it while
+// another one reads it).
+static void writeFileAtomically(const std::string& path, const std::string& content)
+{
+    const std::string tmpFile = path + "." + std::to_string(::getpid()) + ".tmp";
+    std::ofstream o(tmpFile.c_str(), std::ios::binary);
+    o.write(content.data(), content.size());
+    o.close();
+    if(!o || std::rename(tmpFile.c_str(), path.c_str()) != 0) {
+        std::remove(tmpFile.c_str());
+        throw std::runtime_error("could not write '" + path + "'");
+    }
+}
+
+ZarrWriter::ZarrWriter(const std::string& directory, const std::string& dataset,
+                       const vigra::Shape3& shape, const vigra::Shape3& chunkShape, LabelType labelType,
+                       Codec codec, int level, int nThreads, bool update)
+    : ChunkedVolumeWriter(shape, chunkShape, labelType, codec, level, nThreads),
+      arrayDirectory_(directory + "/" + dataset)
+{
+    setUpdating(update);
+
+    makeDirectory(directory);
+    makeDirectory(arrayDirectory_);
+    if(!update) {
+        // empty chunks are not written, so those of an earlier array in
+        // the same place would show through
+        removeArrayFiles(arrayDirectory_);
+    }
+
+    const std::string group = "{\n    \"zarr_format\": 2\n}\n";
+    writeFileAtomically(directory + "/.zgroup", group);
+
+    // chunks are stored in native byte order, which does not apply to
+    // single bytes
+    const uint16_t one = 1;
+    const bool littleEndian = *reinterpret_cast<const char*>(&one) == 1;
+    const size_t size = labelSize(labelType);
+    const char byteOrder = size == 1 ? '|' : littleEndian ? '<' : '>';
+
+    // Zarr lists the axes slowest first, i.e. reversed w.r.t. vigra
+    std::stringstream ss;
+    ss << "{\n"
+       << "    \"zarr_format\": 2,\n"
+       << "    \"shape\": [" << this->shape()[2] << ", " << this->shape()[1] << ", " << this->shape()[0] << "],\n"
+       << "    \"chunks\": [" << this->chunkShape()[2] << ", " << this->chunkShape()[1] << ", " << this->chunkShape()[0] << "],\n"
+       << "    \"dtype\": \"" << byteOrder << "u" << size << "\",\n"
+       << "    \"order\": \"C\",\n"
+       << "    \"fill_value\": 0,\n";
+    if(codec == None) {
+        ss << "    \"compressor\": null,\n";
+    }
+    else {
+        ss << "    \"compressor\": {\"id\": \"zlib\", \"level\": " << level << "},\n";
+    }
+    if(codec == ShuffleGzip) {
+        ss << "    \"filters\": [{\"id\": \"shuffle\", \"elementsize\": " << size << "}]\n";
+    }
+    else {
+        ss << "    \"filters\": null\n";
+    }
+    ss << "}\n";
+    const std::string zarray = ss.str();
+    writeFileAtomically(arrayDirectory_ + "/.zarray", zarray);
+}
+
+std::string ZarrWriter::chunkFile(const vigra::Shape3& chunkIndex) const
+{
+    std::stringstream ss;
+    ss << arrayDirectory_ << "/" << chunkIndex[2] << "." << chunkIndex[1] << "." << chunkIndex[0];
+    return ss.str();
+}
+
+void ZarrWriter::storeChunk(const vigra::Shape3& chunkIndex, const std::vector<char>& data)
+{
+    writeFile(chunkFile(chunkIndex), data.data(), data.size());
+}
+
+bool ZarrWriter::eraseChunk(const vigra::Shape3& chunkIndex)
+{
+    const std::string path = chunkFile(chunkIndex);
+    if(std::remove(path.c_str()) != 0 && errno != ENOENT) {
+        throw std::runtime_error("could not remove '" + path + "': " + std::strerror(errno));
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef ZARRWRITER_H
+#define ZARRWRITER_H
+
+#include <string>
+
+#include "ChunkedVolumeWriter.h"
+
+/**
+ * Writes the label volume as a Zarr (v2) array: a directory with the
+ * array metadata (.zarray) and one file per chunk.
+ *
+ * directory becomes a Zarr group containing the array dataset, i.e. the
+ * labels are at directory/dataset. Chunks are written by the worker
+ * threads as soon as they are encoded; empty chunks are not written at
+ * all and read as zeros (the fill value). The codecs map to numcodecs'
+ * zlib compressor and shuffle filter, so the result can be read with
+ * zarr-python, z5, tensorstore, etc.
+ */
+class ZarrWriter : public ChunkedVolumeWriter {
+    public:
+    /**
+     * Creates directory (if necessary) and the array metadata.
+     * Without update, the chunks of an existing array are removed
+     * first; with update, they are kept, except for those of empty
+     * chunks in the written blocks.
+     * Throws std::runtime_error on failure.
+     */
+    ZarrWriter(const std::string& directory, const std::string& dataset,
+               const vigra::Shape3& shape, const vigra::Shape3& chunkShape, LabelType labelType,
+               Codec codec, int level, int nThreads, bool update = false);
+
+    void close() {}
+
+    protected:
+    void storeChunk(const vigra::Shape3& chunkIndex, const std::vector<char>& data);
+    bool storesConcurrently() const { return true; }
+    bool eraseChunk(const vigra::Shape3& chunkIndex);
+
+    private:
+    std::string chunkFile(const vigra::Shape3& chunkIndex) const;
+
+    std::string arrayDirectory_;
+};
+
+#endif /* ZARRWRITER_H */
@@ -0,0 +1,728 @@
+// Benchmark suite for the stages of surface2volume: OBJ parsing, BVH
+// building, ray traversal, label filling and voting, pyramid downsampling
+// and output writing, whole voxelizations with both engines and point
+// queries.
+//
+// All inputs are generated procedurally with fixed parameters and a fixed
+// seed, so that the numbers are comparable between commits. Every
+// benchmark is repeated until it ran for at least minSeconds (and at
+// least minRepetitions times), the median and minimum time per repetition
+// are reported.
+//
+// Usage: bench [filter]
+// only runs the benchmarks whose name contains filter.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fastbvh/BVH.h>
+
+#include "HDF5ChunkWriter.h"
+#include "LabelPyramid.h"
+#include "LabelSpans.h"
+#include "MajorityVote.h"
+#include "Mesh.h"
+#include "MeshBVH.h"
+#include "Voxelizer.h"
+#include "OBJReader.h"
+#include "PointQuery.h"
+#include "Scene.h"
+#include "Triangle.h"
+
+//
+// procedural meshes
+//
+
+// Triangulated sphere with n rings of m vertices each
+Mesh makeSphere(const Vector3& c, float r, int n, int m)
+{
+    Mesh mesh;
+    mesh.vertices.push_back(c + Vector3(0,0,r));
+    for(int i=1; i<n; ++i) {
+        const float th = M_PI*i/n;
+        for(int j=0; j<m; ++j) {
+            const float ph = 2*M_PI*j/m;
+            mesh.vertices.push_back(c + r*Vector3(std::sin(th)*std::cos(ph),
+                                                  std::sin(th)*std::sin(ph),
+                                                  std::cos(th)));
+        }
+    }
+    mesh.vertices.push_back(c - Vector3(0,0,r));
+    const uint32_t last = mesh.vertices.size()-1;
+    for(int j=0; j<m; ++j) {
+        mesh.faces.push_back({0, uint32_t(1+j), uint32_t(1+(j+1)%m)});
+        mesh.faces.push_back({uint32_t(1+(n-2)*m+j), last, uint32_t(1+(n-2)*m+(j+1)%m)});
+    }
+    for(int i=0; i<n-2; ++i) {
+        for(int j=0; j<m; ++j) {
+            const uint32_t a = 1+i*m+j, b = 1+i*m+(j+1)%m;
+            const uint32_t c = 1+(i+1)*m+(j+1)%m, d = 1+(i+1)*m+j;
+            mesh.faces.push_back({a, d, c});
+            mesh.faces.push_back({a, c, b});
+        }
+    }
+    mesh.setLabel(1);
+    return mesh;
+}
+
+// Triangulated torus around the z axis with radii R and r, with n
+// segments around the axis and m around the tube
+Mesh makeTorus(const Vector3& c, float R, float r, int n, int m)
+{
+    Mesh mesh;
+    for(int i=0; i<n; ++i) {
+        const float u = 2*M_PI*i/n;
+        for(int j=0; j<m; ++j) {
+            const float v = 2*M_PI*j/m;
+            mesh.vertices.push_back(c + Vector3((R + r*std::cos(v))*std::cos(u),
+                                                (R + r*std::cos(v))*std::sin(u),
+                                                r*std::sin(v)));
+        }
+    }
+    for(int i=0; i<n; ++i) {
+        for(int j=0; j<m; ++j) {
+            const uint32_t a = i*m+j, b = i*m+(j+1)%m;
+            const uint32_t c = ((i+1)%n)*m+(j+1)%m, d = ((i+1)%n)*m+j;
+            mesh.faces.push_back({a, b, c});
+            mesh.faces.push_back({a, c, d});
+        }
+    }
+    mesh.setLabel(1);
+    return mesh;
+}
+
+// Deterministic pseudo random numbers in [0, 1), identical on all
+// platforms (unlike the distributions of <random>)
+class Random {
+    public:
+    explicit Random(uint32_t seed) : state_(seed) {}
+    float operator()() {
+        state_ = state_*1664525u + 1013904223u;
+        return (state_ >> 8) / float(1 << 24);
+    }
+    private:
+    uint32_t state_;
+};
+
+// n small spheres ("cells") at random positions in the unit cube
+std::vector<Mesh> makeCells(int n)
+{
+    Random random(42);
+    std::vector<Mesh> cells;
+    for(int i=0; i<n; ++i) {
+        const Vector3 c(random(), random(), random());
+        cells.push_back(makeSphere(c, 0.01f + 0.02f*random(), 8, 16));
+        cells.back().setLabel(i+1);
+    }
+    return cells;
+}
+
+void writeOBJ(const std::string& filename, const std::vector<Mesh>& meshes)
+{
+    std::ofstream o(filename.c_str());
+    uint32_t offset = 1;
+    for(size_t i=0; i<meshes.size(); ++i) {
+        o << "o object" << i << "\n";
+        for(const Vector3& v : meshes[i].vertices) {
+            o << "v " << v[0] << " " << v[1] << " " << v[2] << "\n";
+        }
+        for(const Mesh::Tri& f : meshes[i].faces) {
+            o << "f " << f[0]+offset << " " << f[1]+offset << " " << f[2]+offset << "\n";
+        }
+        offset += meshes[i].vertices.size();
+    }
+}
+
+//
+// benchmark harness
+//
+
+typedef std::chrono::steady_clock Clock;
+
+double seconds(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+const double minSeconds = 0.5;
+const int minRepetitions = 3;
+const int maxRepetitions = 1000;
+
+std::string filter;
+
+bool enabled(const std::string& name) {
+    return name.find(filter) != std::string::npos;
+}
+
+// Runs f repeatedly and prints its median and minimum time, and the
+// throughput of items (in unit) processed per repetition.
+template<class F>
+void run(const std::string& name, double items, const std::string& unit, F f)
+{
+    if(!enabled(name)) {
+        return;
+    }
+    f(); // warm up caches and allocations
+
+    std::vector<double> times;
+    double total = 0;
+    while(times.size() < size_t(maxRepetitions) &&
+          (total < minSeconds || times.size() < size_t(minRepetitions)))
+    {
+        Clock::time_point t0 = Clock::now();
+        f();
+        times.push_back(seconds(t0));
+        total += times.back();
+    }
+    std::sort(times.begin(), times.end());
+    const double median = times[times.size()/2];
+
+    std::cout << std::left << std::setw(36) << name << std::right
+              << std::fixed << std::setprecision(3)
+              << std::setw(12) << 1000*median << " ms"
+              << std::setw(12) << 1000*times.front() << " ms"
+              << std::setw(8) << times.size()
+              << std::setw(12) << std::setprecision(2) << items/median/1e6 << " M" << unit << "/s"
+              << std::endl;
+}
+
+//
+// benchmarks
+//
+
+void benchParse()
+{
+    if(!enabled("parse")) {
+        return;
+    }
+    const std::string filename = "surface2volume_bench.obj";
+    writeOBJ(filename, makeCells(2000));
+    std::ifstream in(filename.c_str(), std::ios::binary | std::ios::ate);
+    const double bytes = in.tellg();
+
+    for(int threads : {1, 4}) {
+        std::stringstream name;
+        name << "parse/cells2000/threads:" << threads;
+        run(name.str(), bytes, "B", [&]() {
+            // silence the object listing
+            std::stringstream sink;
+            std::streambuf* old = std::cout.rdbuf(sink.rdbuf());
+            Scene scene;
+            OBJReader r(filename);
+            r.setNumThreads(threads);
+            r.read(scene);
+            std::cout.rdbuf(old);
+        });
+    }
+    std::remove(filename.c_str());
+}
+
+void benchBuild(const std::string& name, const Mesh& mesh, int threads)
+{
+    run("build/" + name, mesh.faces.size(), "tris", [&]() {
+        Mesh m;
+        m.vertices = mesh.vertices;
+        m.faces = mesh.faces;
+        m.buildBVH(-1.0, threads);
+    });
+}
+
+// Traces a gridSize x gridSize grid of rays along every axis through the
+// bounding box of mesh, with the scalar and the packet traversal, over
+// triangles in the given layout (quantized to 65536 steps over the
+// bounding box). Returns false if they found different hits.
+bool benchTrace(const std::string& name, Mesh& mesh, int gridSize,
+                TriangleStore::Layout layout = TriangleStore::Expanded)
+{
+    const BBox bb = mesh.bbox();
+    VertexGrid grid;
+    grid.start = bb.min;
+    grid.step = (1.0f / 65535.0f) * bb.extent;
+    if(layout == TriangleStore::Expanded) {
+        mesh.buildBVH(-1.0);
+    }
+    else {
+        mesh.buildCompactBVH(-1.0, layout == TriangleStore::Quantized ? &grid : 0);
+    }
+    const MeshBVH& bvh = *mesh.bvh();
+    const double nRays = double(gridSize)*gridSize;
+    if(enabled("trace/" + name)) {
+        std::cout << "trace/" << name << ": triangles take " << bvh.triangles().memoryUsage() / 1024 << " KB ("
+                  << bvh.triangles().expandedMemoryUsage() / 1024 << " KB expanded)" << std::endl;
+    }
+
+    bool ok = true;
+    for(int axis=0; axis<3; ++axis) {
+        const int uAxis = axis == 0 ? 1 : 0;
+        const int vAxis = axis == 2 ? 1 : 2;
+        Vector3 d(0,0,0);
+        d[axis] = 1;
+        auto coor = [&](int dim, int i) { return bb.min[dim] + bb.extent[dim]*(i+0.5f)/gridSize; };
+        auto ray = [&](int a, int b) {
+            Vector3 o(0,0,0);
+            o[axis] = bb.min[axis] - 1; o[uAxis] = coor(uAxis, a); o[vAxis] = coor(vAxis, b);
+            return Ray(o, d);
+        };
+        auto packet = [&](int a, int b) {
+            AxisRayPacket4 p;
+            p.axis = axis;
+            p.nRays = 4;
+            p.start = bb.min[axis] - 1;
+            for(int i=0; i<4; ++i) {
+                p.u[i] = coor(uAxis, a);
+                p.v[i] = coor(vAxis, b+i);
+            }
+            return p;
+        };
+
+        std::vector<RayHit> hits[4];
+        std::vector<RayHit> scalarHits;
+        std::stringstream prefix;
+        prefix << "trace/" << name << "/axis:" << axis;
+
+        run(prefix.str() + "/scalar", nRays, "rays", [&]() {
+            for(int a=0; a<gridSize; ++a) {
+                for(int b=0; b<gridSize; ++b) {
+                    bvh.getAllIntersections(ray(a, b), hits[0]);
+                }
+            }
+        });
+        run(prefix.str() + "/packet", nRays, "rays", [&]() {
+            for(int a=0; a<gridSize; ++a) {
+                for(int b=0; b<gridSize; b+=4) {
+                    bvh.getAllIntersections4(packet(a, b), hits);
+                }
+            }
+        });
+
+        if(!enabled(prefix.str())) {
+            continue;
+        }
+        // both must find exactly the same hits
+        for(int a=0; a<gridSize; ++a) {
+            for(int b=0; b<gridSize; b+=4) {
+                bvh.getAllIntersections4(packet(a, b), hits);
+                for(int i=0; i<4; ++i) {
+                    bvh.getAllIntersections(ray(a, b+i), scalarHits);
+                    ok = ok && scalarHits.size() == hits[i].size();
+                    for(size_t k=0; ok && k<scalarHits.size(); ++k) {
+                        ok = scalarHits[k].t == hits[i][k].t && scalarHits[k].prim == hits[i][k].prim;
+                    }
+                }
+            }
+        }
+    }
+
+    // Fast-BVH's closest hit query, for reference
+    const std::string fastbvhName = "trace/" + name + "/fastbvh-closest";
+    if(layout == TriangleStore::Expanded && enabled(fastbvhName)) {
+        // stored by value, Fast-BVH only reorders pointers to them
+        std::vector<Triangle> triangles;
+        triangles.reserve(mesh.faces.size());
+        for(const Mesh::Tri& f : mesh.faces) {
+            triangles.push_back(Triangle(mesh.vertices[f[0]], mesh.vertices[f[1]], mesh.vertices[f[2]], mesh.label()));
+        }
+        std::vector<Object*> objects;
+        for(Triangle& t : triangles) {
+            objects.push_back(&t);
+        }
+        BVH fastbvh(&objects);
+        run(fastbvhName, nRays, "rays", [&]() {
+            IntersectionInfo info;
+            for(int a=0; a<gridSize; ++a) {
+                for(int b=0; b<gridSize; ++b) {
+                    const Vector3 o(bb.min[0] + bb.extent[0]*(a+0.5f)/gridSize,
+                                    bb.min[1] + bb.extent[1]*(b+0.5f)/gridSize,
+                                    bb.min[2] - 1);
+                    fastbvh.getIntersection(Ray(o, Vector3(0,0,1)), &info, false);
+                }
+            }
+        });
+    }
+    return ok;
+}
+
+// A size^3 volume of nested boxes of labels 1..nLabels, as the rays
+// along the three axes would produce it
+vigra::MultiArray<3, uint16_t> makeLabels(int size, int nLabels, int shift)
+{
+    vigra::MultiArray<3, uint16_t> labels(vigra::Shape3(size, size, size));
+    for(int z=0; z<size; ++z) {
+        for(int y=0; y<size; ++y) {
+            for(int x=0; x<size; ++x) {
+                const int d = std::min(std::min(std::min(x, y), std::min(z, size-1-x)),
+                                       std::min(size-1-y, size-1-z)) + shift;
+                labels(x, y, z) = std::max(0, std::min(nLabels, d * 2 * nLabels / size));
+            }
+        }
+    }
+    return labels;
+}
+
+vigra::MultiArray<3, uint16_t> copyBlock(const vigra::MultiArray<3, uint16_t>& labels,
+                                         const vigra::Shape3& offset, const vigra::Shape3& shape)
+{
+    vigra::MultiArray<3, uint16_t> block(shape);
+    for(int z=0; z<shape[2]; ++z) {
+        for(int y=0; y<shape[1]; ++y) {
+            for(int x=0; x<shape[0]; ++x) {
+                block(x, y, z) = labels(offset[0]+x, offset[1]+y, offset[2]+z);
+            }
+        }
+    }
+    return block;
+}
+
+void benchFillAndVote()
+{
+    const int size = 256;
+    const double nVoxels = double(size)*size*size;
+
+    if(enabled("fill/spans")) {
+        // every ray line crosses 8 objects; expand into a contiguous line
+        std::vector<RayLabelSpans> spans(size*size);
+        std::vector<uint16_t> line(size);
+        run("fill/spans", nVoxels, "voxels", [&]() {
+            for(size_t r=0; r<spans.size(); ++r) {
+                RayLabelSpans& s = spans[r];
+                s.clear();
+                for(int k=0; k<8; ++k) {
+                    s.paint(k*size/8 + r%7, (k+1)*size/8 - 2, k+1);
+                }
+                s.fill(line.data(), 0, 1);
+            }
+        });
+    }
+
+    if(enabled("vote")) {
+        typedef vigra::MultiArray<3, uint16_t> Labels;
+        const Labels first = makeLabels(size, 16, 0);
+        const Labels second = makeLabels(size, 16, 1);
+        const Labels third = makeLabels(size, 16, -1);
+
+        // the tiles of the second and third axis, as surface2volume
+        // passes them to the vote
+        const int block = 32;
+        std::vector<std::pair<Labels, vigra::Shape3> > secondBlocks, thirdBlocks;
+        for(int z=0; z<size; z+=block) {
+            for(int i=0; i<size; i+=block) {
+                secondBlocks.push_back(std::make_pair(copyBlock(second, vigra::Shape3(i, 0, z), vigra::Shape3(block, size, block)),
+                                                      vigra::Shape3(i, 0, z)));
+                thirdBlocks.push_back(std::make_pair(copyBlock(third, vigra::Shape3(0, i, z), vigra::Shape3(size, block, block)),
+                                                     vigra::Shape3(0, i, z)));
+            }
+        }
+
+        Labels out;
+        run("vote/nested-boxes", nVoxels, "voxels", [&]() {
+            out = first;
+            MajorityVote<uint16_t> vote(out);
+            for(const auto& b : secondBlocks) {
+                vote.addSecond(b.first, b.second);
+            }
+            vote.finishSecond();
+            for(const auto& b : thirdBlocks) {
+                vote.addThird(b.first, b.second);
+            }
+        });
+    }
+
+    if(enabled("pyramid")) {
+        const vigra::MultiArray<3, uint16_t> labels = makeLabels(size, 16, 0);
+        vigra::MultiArray<3, uint16_t> out;
+        for(int threads : {1, 4}) {
+            std::stringstream name;
+            name << "pyramid/nested-boxes/threads:" << threads;
+            run(name.str(), nVoxels, "voxels", [&]() {
+                downsampleLabels(labels, out, threads);
+            });
+        }
+    }
+}
+
+// Returns whether the rasterizer and a voxelization in slabs give the
+// same labels as the ray tracer.
+bool benchVoxelize()
+{
+    // many small, dense meshes, including the BVH build or the
+    // rasterizer's preparation
+    const int size = 192;
+    const std::vector<Mesh> cells = makeCells(4000);
+    std::vector<std::vector<float> > vertices(cells.size());
+    std::vector<MeshBuffers> buffers;
+    for(size_t i=0; i<cells.size(); ++i) {
+        for(const Vector3& v : cells[i].vertices) {
+            vertices[i].insert(vertices[i].end(), {v[0], v[1], v[2]});
+        }
+        MeshBuffers b = {vertices[i].data(), cells[i].vertices.size(),
+                         cells[i].faces[0].data(), cells[i].faces.size()};
+        buffers.push_back(b);
+    }
+    const vigra::Shape3 shape(size, size, size);
+
+    // the labels of the ray tracer, which every other run has to match
+    vigra::MultiArray<3, uint16_t> expected;
+    bool ok = true;
+    auto compare = [&](const std::string& name, const vigra::MultiArray<3, uint16_t>& labels,
+                       const vigra::Shape3& offset) {
+        if(expected.size() == 0) {
+            expected.reshape(shape);
+            Voxelizer v(buffers, Vector3(0, 0, 0), Vector3(1, 1, 1), shape);
+            v.setNumThreads(4);
+            v.voxelize(expected);
+        }
+        size_t wrong = 0;
+        for(int z=0; z<labels.shape(2); ++z) {
+            for(int y=0; y<labels.shape(1); ++y) {
+                for(int x=0; x<labels.shape(0); ++x) {
+                    wrong += labels(x, y, z) != expected(offset[0]+x, offset[1]+y, offset[2]+z);
+                }
+            }
+        }
+        if(wrong > 0) {
+            std::cout << "ERROR: " << name << ": " << wrong << " voxels differ from the ray tracer" << std::endl;
+            ok = false;
+        }
+    };
+
+    vigra::MultiArray<3, uint16_t> labels(shape);
+    const Voxelizer::Engine engines[] = {Voxelizer::RayTracing, Voxelizer::Rasterization};
+    const char* names[] = {"trace", "raster"};
+    for(int e=0; e<2; ++e) {
+        for(int threads : {1, 4}) {
+            std::stringstream name;
+            name << "voxelize/cells4k/" << names[e] << "/threads:" << threads;
+            if(!enabled(name.str())) {
+                continue;
+            }
+            run(name.str(), double(size)*size*size, "voxels", [&]() {
+                Voxelizer v(buffers, Vector3(0, 0, 0), Vector3(1, 1, 1), shape);
+                v.setEngine(engines[e]);
+                v.setNumThreads(threads);
+                v.voxelize(labels);
+            });
+            compare(name.str(), labels, vigra::Shape3(0, 0, 0));
+        }
+
+        // in slabs of 64 planes, and a block not aligned to them, as with
+        // --slab and --roi
+        const std::string slabsName = std::string("voxelize/cells4k/") + names[e] + "/slabs:3";
+        if(enabled(slabsName)) {
+            const int planes = size / 3;
+            std::vector<vigra::MultiArray<3, uint16_t> > slabs(3, vigra::MultiArray<3, uint16_t>(vigra::Shape3(size, size, planes)));
+            run(slabsName, double(size)*size*size, "voxels", [&]() {
+                Voxelizer v(buffers, Vector3(0, 0, 0), Vector3(1, 1, 1), shape);
+                v.setEngine(engines[e]);
+                v.setNumThreads(4);
+                for(int i=0; i<3; ++i) {
+                    v.voxelize(slabs[i], vigra::Shape3(0, 0, i*planes), vigra::Shape3(size, size, (i+1)*planes));
+                }
+            });
+            for(int i=0; i<3; ++i) {
+                compare(slabsName, slabs[i], vigra::Shape3(0, 0, i*planes));
+            }
+
+            const vigra::Shape3 roiBegin(37, 50, 61), roiEnd(121, 190, 150);
+            vigra::MultiArray<3, uint16_t> block(roiEnd - roiBegin);
+            Voxelizer v(buffers, Vector3(0, 0, 0), Vector3(1, 1, 1), shape);
+            v.setEngine(engines[e]);
+            v.setNumThreads(4);
+            v.voxelize(block, roiBegin, roiEnd);
+            compare(std::string("voxelize/cells4k/") + names[e] + "/roi", block, roiBegin);
+        }
+    }
+    return ok;
+}
+
+// Voxelizes a sphere on a grid with a different number of voxels along
+// each axis and compares every voxel with Mesh::contains() at its
+// center. The two may only disagree next to the surface, where the
+// voxel rounding of the ray crossings applies.
+bool benchVoxelizeShape()
+{
+    const std::string prefix = "voxelize/sphere-64x96x128/";
+    if(!enabled(prefix + "trace") && !enabled(prefix + "raster")) {
+        return true;
+    }
+    Mesh sphere = makeSphere(Vector3(0.5f, 0.5f, 0.5f), 0.4f, 64, 128);
+    sphere.buildBVH(-1.0);
+    std::vector<float> vertices;
+    for(const Vector3& v : sphere.vertices) {
+        vertices.insert(vertices.end(), {v[0], v[1], v[2]});
+    }
+    const std::vector<MeshBuffers> buffers(1, MeshBuffers{vertices.data(), sphere.vertices.size(),
+                                                          sphere.faces[0].data(), sphere.faces.size()});
+
+    // 64 x 96 x 128 voxels along the scene's x, y and z axes, in vigra order
+    const vigra::Shape3 shape(128, 96, 64);
+    vigra::MultiArray<3, uint8_t> inside(shape);
+    for(int k=0; k<shape[2]; ++k) {
+        for(int j=0; j<shape[1]; ++j) {
+            for(int i=0; i<shape[0]; ++i) {
+                const Vector3 p((k+0.5f)/shape[2], (j+0.5f)/shape[1], (i+0.5f)/shape[0]);
+                inside(i, j, k) = sphere.contains(p);
+            }
+        }
+    }
+    auto nearSurface = [&](int i, int j, int k) {
+        const int n[6][3] = {{-1,0,0}, {1,0,0}, {0,-1,0}, {0,1,0}, {0,0,-1}, {0,0,1}};
+        for(const auto& d : n) {
+            const int a = i+d[0], b = j+d[1], c = k+d[2];
+            if(a >= 0 && a < shape[0] && b >= 0 && b < shape[1] && c >= 0 && c < shape[2]
+               && inside(a, b, c) != inside(i, j, k)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    bool ok = true;
+    vigra::MultiArray<3, uint8_t> labels(shape);
+    const Voxelizer::Engine engines[] = {Voxelizer::RayTracing, Voxelizer::Rasterization};
+    const char* names[] = {"trace", "raster"};
+    for(int e=0; e<2; ++e) {
+        const std::string name = prefix + names[e];
+        run(name, double(labels.size()), "voxels", [&]() {
+            Voxelizer v(buffers, Vector3(0, 0, 0), Vector3(1, 1, 1), shape);
+            v.setEngine(engines[e]);
+            v.voxelize(labels);
+        });
+        if(!enabled(name)) {
+            continue;
+        }
+        size_t wrong = 0;
+        for(int k=0; k<shape[2]; ++k) {
+            for(int j=0; j<shape[1]; ++j) {
+                for(int i=0; i<shape[0]; ++i) {
+                    if(labels(i, j, k) != inside(i, j, k) && !nearSurface(i, j, k)) {
+                        ++wrong;
+                    }
+                }
+            }
+        }
+        if(wrong > 0) {
+            std::cout << "ERROR: " << name << ": " << wrong << " voxels away from the surface differ from Mesh::contains"
+                      << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void benchQuery()
+{
+    if(!enabled("query")) {
+        return;
+    }
+    // random points among many small cells, most of them outside
+    Scene scene;
+    scene.meshes = makeCells(4000);
+    for(Mesh& m : scene.meshes) {
+        m.buildBVH(-1.0);
+    }
+    const size_t n = 250000;
+    Random random(7);
+    std::vector<float> points(3*n);
+    for(float& p : points) {
+        p = random();
+    }
+    std::vector<uint32_t> labels(n);
+    PointQuery query(scene);
+    for(int threads : {1, 4}) {
+        std::stringstream name;
+        name << "query/cells4k/threads:" << threads;
+        query.setNumThreads(threads);
+        run(name.str(), double(n), "points", [&]() {
+            query.labels(points.data(), n, labels.data());
+        });
+    }
+}
+
+void benchWrite()
+{
+    if(!enabled("write")) {
+        return;
+    }
+    const int size = 256;
+    const vigra::MultiArray<3, uint16_t> labels = makeLabels(size, 16, 0);
+    const std::string filename = "surface2volume_bench.h5";
+    const double bytes = labels.size()*sizeof(uint16_t);
+
+    const char* codecs[] = {"none", "gzip", "shuffle-gzip"};
+    for(const char* codec : codecs) {
+        for(int threads : {1, 4}) {
+            std::stringstream name;
+            name << "write/hdf5/" << codec << "/threads:" << threads;
+            run(name.str(), bytes, "B", [&]() {
+                HDF5ChunkWriter w(filename, "labels", labels.shape(), vigra::Shape3(64, 64, 64), Label16,
+                                  ChunkedVolumeWriter::parseCodec(codec), 1, threads);
+                w.write(labels, vigra::Shape3(0, 0, 0));
+                w.close();
+            });
+        }
+    }
+    // the same labels in half the bytes, as for scenes of < 256 objects
+    vigra::MultiArray<3, uint8_t> labels8(labels.shape());
+    std::copy(labels.data(), labels.data() + labels.size(), labels8.data());
+    for(int threads : {1, 4}) {
+        std::stringstream name;
+        name << "write/hdf5/gzip/uint8/threads:" << threads;
+        run(name.str(), double(labels8.size()), "B", [&]() {
+            HDF5ChunkWriter w(filename, "labels", labels8.shape(), vigra::Shape3(64, 64, 64), Label8,
+                              ChunkedVolumeWriter::Gzip, 1, threads);
+            w.write(labels8, vigra::Shape3(0, 0, 0));
+            w.close();
+        });
+    }
+    std::remove(filename.c_str());
+}
+
+int main(int argc, char **argv) {
+    if(argc > 1) {
+        filter = argv[1];
+    }
+
+    std::cout << std::left << std::setw(36) << "benchmark" << std::right
+              << std::setw(15) << "median" << std::setw(15) << "min"
+              << std::setw(8) << "reps" << std::setw(18) << "throughput" << std::endl;
+
+    benchParse();
+
+    Mesh sphere = makeSphere(Vector3(0,0,0), 1.0f, 256, 512);
+    Mesh torus = makeTorus(Vector3(0,0,0), 1.0f, 0.3f, 512, 128);
+    Mesh huge = makeSphere(Vector3(0,0,0), 1.0f, 1024, 1024);
+    for(int threads : {1, 4}) {
+        std::stringstream suffix;
+        suffix << "/threads:" << threads;
+        benchBuild("sphere262k" + suffix.str(), sphere, threads);
+        benchBuild("torus131k" + suffix.str(), torus, threads);
+        benchBuild("sphere2M" + suffix.str(), huge, threads);
+    }
+
+    bool ok = true;
+    ok = benchTrace("sphere262k", sphere, 512) && ok;
+    ok = benchTrace("torus131k", torus, 512) && ok;
+    ok = benchTrace("sphere262k/compact", sphere, 512, TriangleStore::Indexed) && ok;
+    ok = benchTrace("torus131k/compact", torus, 512, TriangleStore::Indexed) && ok;
+    ok = benchTrace("sphere262k/quantized", sphere, 512, TriangleStore::Quantized) && ok;
+    ok = benchTrace("torus131k/quantized", torus, 512, TriangleStore::Quantized) && ok;
+
+    benchFillAndVote();
+    bool voxelsOk = benchVoxelize();
+    voxelsOk = benchVoxelizeShape() && voxelsOk;
+    benchQuery();
+    benchWrite();
+
+    if(!ok) {
+        std::cout << "ERROR: packet and scalar traversal found different hits" << std::endl;
+        return 1;
+    }
+    return voxelsOk ? 0 : 1;
+}
@@ -1,24 +1,32 @@
 #include <iostream>
 #include <fstream>
-#include <array>
 #include <vector>
-#include <map>
 #include <sstream>
-#include <cmath>
+#include <memory>
+#include <chrono>
+#include <iomanip>
+
+#include <unistd.h>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 #include <boost/regex.hpp>
 
-#include <fastbvh/BVH.h>
-
 #include <vigra/multi_array.hxx>
-#include <vigra/hdf5impex.hxx>
 
-#include "Triangle.h"
 #include "Mesh.h"
 #include "OBJReader.h"
+#include "SceneCache.h"
 #include "CmdlineUtils.h"
+#include "HDF5ChunkWriter.h"
+#include "LabelPyramid.h"
+#include "OutputManifest.h"
+#include "ZarrWriter.h"
+#include "Parallel.h"
+#include "PointQuery.h"
+#include "ProgressReporter.h"
+#include "TraversalStats.h"
+#include "Voxelizer.h"
 
 std::ostream& operator<<(std::ostream& o, const Vector3& v) {
     o << "(" << v[0] << ", " << v[1] << ", " << v[2] << ")";
@@ -27,6 +35,210 @@ std::ostream& operator<<(std::ostream& o, const Vector3& v) {
 
 namespace po = boost::program_options;
 
+// Returns s as a JSON string literal.
+static std::string jsonString(const std::string& s) {
+    std::stringstream ss;
+    ss << '"';
+    for(char c : s) {
+        if(c == '"' || c == '\\') {
+            ss << '\\' << c;
+        }
+        else if(static_cast<unsigned char>(c) < 0x20) {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        }
+        else {
+            ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+// With the traversal counters compiled in (see TraversalStats), prints
+// the work done for every object, most expensive first.
+static void printTraversalCost(const Scene& scn)
+{
+    using std::cout;
+    using std::endl;
+
+    if(!TraversalStats::enabled()) {
+        return;
+    }
+    std::vector<std::string> names;
+    for(const Mesh& m : scn.meshes) {
+        names.push_back(m.name());
+    }
+    cout << endl << "*** traversal cost per object" << endl;
+    TraversalStats::report(cout, names);
+}
+
+// Labels the points in pointsFile (float32 x, y, z triples) by the object
+// of objFile containing them (see PointQuery) and writes the labels to
+// outFile (one uint32 per point), both in native byte order.
+static int queryPoints(const std::string& objFile, const std::string& cacheFile, int maxObjects,
+                       const std::string& pointsFile, const std::string& outFile, int nThreads)
+{
+    using std::cout;
+    using std::endl;
+
+    std::ifstream in(pointsFile.c_str(), std::ios::binary | std::ios::ate);
+    if(!in) {
+        cout << "could not open " << pointsFile << endl;
+        return 1;
+    }
+    const std::streamoff size = in.tellg();
+    if(size % (3*sizeof(float)) != 0) {
+        cout << pointsFile << " does not hold float32 x, y, z triples (" << size << " bytes)" << endl;
+        return 1;
+    }
+    std::vector<float> points(size / sizeof(float));
+    in.seekg(0);
+    in.read(reinterpret_cast<char*>(points.data()), size);
+    if(!in) {
+        cout << "could not read " << pointsFile << endl;
+        return 1;
+    }
+    const size_t n = points.size() / 3;
+    cout << "points:             " << n << " from " << pointsFile << endl;
+    cout << "threads:            " << nThreads << endl << endl;
+
+    ProgressReporter progress(cout);
+    Scene scn;
+    std::unique_ptr<SceneCache> cache;
+    if(!cacheFile.empty()) {
+        cache.reset(new SceneCache(cacheFile, objFile, maxObjects, -1.0f));
+    }
+    progress.beginPhase("parse", 0, "objects");
+    const bool cached = cache && cache->read(scn);
+    if(!cached) {
+        OBJReader r(objFile);
+        if(maxObjects > 0) {
+            r.setMaxObjects(maxObjects);
+        }
+        r.setNumThreads(nThreads);
+        r.read(scn);
+    }
+    progress.add(scn.meshes.size());
+    progress.endPhase();
+    if(!cached) {
+        // as when voxelizing: large meshes one after the other, using all
+        // threads, all other meshes concurrently
+        const size_t largeMeshFaces = 1 << 16;
+        std::vector<size_t> smallMeshes;
+        progress.beginPhase("build BVH", scn.meshes.size(), "objects");
+        for(size_t i=0; i<scn.meshes.size(); ++i) {
+            if(scn.meshes[i].faces.size() >= largeMeshFaces) {
+                scn.meshes[i].buildBVH(-1.0f, nThreads);
+                progress.add(1);
+            }
+            else {
+                smallMeshes.push_back(i);
+            }
+        }
+        parallelFor(smallMeshes.size(), nThreads, [&](size_t k, int) {
+            scn.meshes[smallMeshes[k]].buildBVH(-1.0f);
+            progress.add(1);
+        });
+        progress.endPhase();
+        if(cache) {
+            cache->write(scn);
+        }
+    }
+
+    std::vector<uint32_t> labels(n);
+    PointQuery query(scn);
+    query.setNumThreads(nThreads);
+    query.setProgress(&progress);
+    query.labels(points.data(), n, labels.data());
+
+    std::ofstream out(outFile.c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char*>(labels.data()), n*sizeof(uint32_t));
+    out.close();
+    if(!out) {
+        cout << "could not write " << outFile << endl;
+        return 1;
+    }
+    const size_t inside = n - std::count(labels.begin(), labels.end(), 0u);
+    cout << endl << "wrote " << n << " labels to " << outFile << " (" << inside << " points inside an object)" << endl;
+    cout << endl << "*** summary" << endl;
+    progress.summary(cout);
+    printTraversalCost(scn);
+    return 0;
+}
+
+// Voxelizes each of regions in slabs of slabThickness planes (rounded up
+// to whole chunks, 0 for a single slab) with labels of type T, and writes
+// every slab and its downsampled scales (one per scale writer).
+template<class T>
+static void voxelizeRegions(Voxelizer& voxelizer, const std::vector<OutputManifest::Region>& regions,
+                            const vigra::Shape3& shape, const vigra::Shape3& chunks, int slabThickness,
+                            ChunkedVolumeWriter& writer,
+                            const std::vector<std::unique_ptr<ChunkedVolumeWriter> >& scaleWriters,
+                            int nThreads, ProgressReporter& progress)
+{
+    using std::cout;
+    using std::endl;
+
+    const int nScales = scaleWriters.size();
+    vigra::MultiArray<3, T> labels;
+    vigra::MultiArray<3, T> scaleLabels[2];
+    for(const OutputManifest::Region& region : regions) {
+        if(regions.size() > 1) {
+            cout << "*** region (" << region.first[2] << ", " << region.first[1] << ", " << region.first[0] << ")("
+                 << region.second[2] << ", " << region.second[1] << ", " << region.second[0] << ")" << endl << endl;
+        }
+        
+        // Each region is voxelized in slabs [slabBegin, slabEnd) along its
+        // last (slowest varying) axis, which is also the last axis of the
+        // output dataset. Only the labels of the current slab are kept in
+        // memory. By default, there is a single slab covering the whole
+        // region.
+        const vigra::MultiArrayIndex nPlanes = region.second[2] - region.first[2];
+        vigra::MultiArrayIndex thickness = slabThickness;
+        if(thickness <= 0 || thickness > nPlanes) {
+            thickness = nPlanes;
+        }
+        // every slab has to consist of whole chunks
+        if(thickness < nPlanes) {
+            const vigra::MultiArrayIndex c = chunks[2];
+            thickness = std::min<vigra::MultiArrayIndex>((thickness + c - 1) / c * c, nPlanes);
+        }
+        
+        for(vigra::MultiArrayIndex slabBegin = region.first[2], slabEnd; slabBegin < region.second[2]; slabBegin = slabEnd) {
+            slabEnd = std::min<vigra::MultiArrayIndex>(slabBegin + thickness, region.second[2]);
+            if(thickness < nPlanes) {
+                cout << "*** slab [" << slabBegin << ", " << slabEnd << ") of " << shape[2] << endl << endl;
+            }
+            const vigra::Shape3 slabBegin3(region.first[0], region.first[1], slabBegin);
+            const vigra::Shape3 slabEnd3(region.second[0], region.second[1], slabEnd);
+            labels.reshape(slabEnd3 - slabBegin3);
+            voxelizer.voxelize(labels, slabBegin3, slabEnd3);
+        
+            progress.beginPhase("write", 1, "slabs");
+            writer.write(labels, slabBegin3);
+            progress.add(1);
+            progress.endPhase();
+            
+            if(nScales > 0) {
+                progress.beginPhase("pyramid", nScales, "scales");
+                const vigra::MultiArray<3, T>* finer = &labels;
+                for(int scale=1; scale<=nScales; ++scale) {
+                    vigra::MultiArray<3, T>& coarser = scaleLabels[scale % 2];
+                    downsampleLabels(*finer, coarser, nThreads);
+                    const vigra::MultiArrayIndex f = vigra::MultiArrayIndex(1) << scale;
+                    scaleWriters[scale-1]->write(coarser, vigra::Shape3(slabBegin3[0] / f, slabBegin3[1] / f,
+                                                                        slabBegin3[2] / f));
+                    finer = &coarser;
+                    progress.add(1);
+                }
+                progress.endPhase();
+            }
+            if(thickness < nPlanes) {
+                cout << endl;
+            }
+        } /* slab iteration */
+    } /* region iteration */
+}
 
 int main(int argc, char **argv) {
     using std::cout;
@@ -45,6 +257,51 @@ int main(int argc, char **argv) {
          "maximal number of objects read in")
         ("out", po::value<std::string>(),
          "output file.           Example: 'volume.h5'"      )
+        ("format", po::value<std::string>(),
+         "output format: hdf5 (default) or zarr (a directory of chunks)")
+        ("threads", po::value<int>(),
+         "number of tracing threads (default: all cores)")
+        ("engine", po::value<std::string>(),
+         "voxelization engine: trace (default, rays through per-object BVHs) or raster "
+         "(rasterize the triangles onto the rays, no BVHs)")
+        ("packets",
+         "trace four neighbouring rays at once (SSE)")
+        ("scene-bvh",
+         "trace all objects in a single sweep through a scene-wide BVH")
+        ("compact",
+         "store the triangles of each object as indices into its welded vertices instead of one "
+         "vertex and two edges per triangle (less memory, same output)")
+        ("quantize",
+         "like --compact, with the vertices snapped to a 16 bit grid over --scene (even less memory; "
+         "voxels at object boundaries can change)")
+        ("roi", po::value<IndexBBox>(),
+         "only voxelize the block [begin, end) of the output, in the order of --shape and aligned to chunks, "
+         "and write it into the (existing) output. Example: '(0,0,0)(128,64,64)'")
+        ("tile", po::value<TileIndex>(),
+         "only voxelize tile i of N (whole chunks along the first axis of --shape), like --roi. Example: '3/8'. "
+         "Zarr tiles can run at the same time, HDF5 tiles have to run one after the other (HDF5 allows a single writer)")
+        ("incremental",
+         "keep a manifest of the objects next to the output (OUT.manifest); if one of an earlier run "
+         "with the same settings exists, only re-voxelize the regions of the objects which were "
+         "added, removed or changed since")
+        ("slab", po::value<int>(),
+         "voxelize the volume in slabs of this many planes (along its last axis) to bound memory")
+        ("chunk", po::value<vigra::Shape3>(),
+         "chunk shape of the output (default: '(64,64,64)')")
+        ("codec", po::value<std::string>(),
+         "compression of the output chunks: none, gzip (default) or shuffle-gzip")
+        ("level", po::value<int>(),
+         "gzip compression level (default: 1)")
+        ("pyramid", po::value<int>(),
+         "also write this many downsampled scales (by 2, majority label) as datasets labels_s1, labels_s2, ...; "
+         "the chunk shape must be a multiple of 2^N")
+        ("stats", po::value<std::string>(),
+         "write a JSON summary of the run (timings, rays/s, hits/s, output size) to this file")
+        ("cache", po::value<std::string>(),
+         "scene cache file, written on the first run, reused while the .obj file is unchanged")
+        ("points", po::value<std::string>(),
+         "instead of voxelizing, label the points in this file (float32 x, y, z triples) by the object "
+         "containing them; --out receives one uint32 label per point (--scene and --shape are not needed)")
     ;
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -55,6 +312,24 @@ int main(int argc, char **argv) {
     FloatBBox sceneBBox;
     vigra::Shape3 shape;
     int maxObjects = -1;
+    int nThreads = defaultNumThreads();
+    Voxelizer::Engine engine = Voxelizer::RayTracing;
+    bool usePackets = false;
+    bool useSceneBVH = false;
+    TriangleStore::Layout triangleLayout = TriangleStore::Expanded;
+    int slabThickness = 0;
+    IndexBBox roi;
+    TileIndex tile;
+    bool useROI = false;
+    bool useTile = false;
+    bool incremental = false;
+    int nScales = 0;
+    vigra::Shape3 chunkShape(64, 64, 64);
+    std::string format = "hdf5";
+    ChunkedVolumeWriter::Codec codec = ChunkedVolumeWriter::Gzip;
+    int compressionLevel = 1;
+    std::string cacheFile;
+    std::string statsFile;
 
     if (vm.count("help")) {
         cout << desc << endl;
@@ -71,7 +346,7 @@ int main(int argc, char **argv) {
     if (vm.count("scene")) {
         sceneBBox = vm["scene"].as<FloatBBox>();
     }
-    else {
+    else if (!vm.count("points")) {
         cout << "No scene bounding box specified" << endl;
         cout << desc << endl;
         return 1;
@@ -79,7 +354,7 @@ int main(int argc, char **argv) {
     if (vm.count("shape")) {
         shape = vm["shape"].as<vigra::Shape3>();
     }
-    else {
+    else if (!vm.count("points")) {
         cout << "No output shape specified" << endl;
         cout << desc << endl;
         return 1;
@@ -95,6 +370,95 @@ int main(int argc, char **argv) {
     if (vm.count("max")) {
         maxObjects = vm["max"].as<int>();
     }
+    if (vm.count("threads")) {
+        nThreads = std::max(1, vm["threads"].as<int>());
+    }
+    if (vm.count("packets")) {
+        usePackets = true;
+    }
+    if (vm.count("scene-bvh")) {
+        useSceneBVH = true;
+    }
+    if (vm.count("compact")) {
+        triangleLayout = TriangleStore::Indexed;
+    }
+    if (vm.count("quantize")) {
+        triangleLayout = TriangleStore::Quantized;
+    }
+    if (vm.count("engine")) {
+        const std::string name = vm["engine"].as<std::string>();
+        if(name == "raster") {
+            engine = Voxelizer::Rasterization;
+        }
+        else if(name != "trace") {
+            cout << "Unknown engine '" << name << "'" << endl;
+            cout << desc << endl;
+            return 1;
+        }
+        if(engine == Voxelizer::Rasterization && (usePackets || useSceneBVH)) {
+            cout << "--packets and --scene-bvh only apply to --engine trace" << endl;
+            cout << desc << endl;
+            return 1;
+        }
+    }
+    if (vm.count("roi")) {
+        roi = vm["roi"].as<IndexBBox>();
+        useROI = true;
+    }
+    if (vm.count("tile")) {
+        tile = vm["tile"].as<TileIndex>();
+        useTile = true;
+    }
+    if (useROI && useTile) {
+        cout << "Only one of --roi and --tile can be given" << endl;
+        cout << desc << endl;
+        return 1;
+    }
+    if (vm.count("incremental")) {
+        incremental = true;
+        if(useROI || useTile) {
+            cout << "--incremental cannot be combined with --roi or --tile" << endl;
+            cout << desc << endl;
+            return 1;
+        }
+    }
+    if (vm.count("slab")) {
+        slabThickness = vm["slab"].as<int>();
+    }
+    if (vm.count("format")) {
+        format = vm["format"].as<std::string>();
+        if(format != "hdf5" && format != "zarr") {
+            cout << "Unknown output format '" << format << "'" << endl;
+            cout << desc << endl;
+            return 1;
+        }
+    }
+    if (vm.count("chunk")) {
+        chunkShape = vm["chunk"].as<vigra::Shape3>();
+    }
+    if (vm.count("codec")) {
+        codec = ChunkedVolumeWriter::parseCodec(vm["codec"].as<std::string>());
+    }
+    if (vm.count("level")) {
+        compressionLevel = vm["level"].as<int>();
+    }
+    if (vm.count("pyramid")) {
+        nScales = vm["pyramid"].as<int>();
+        if(nScales < 0 || nScales > 16) {
+            cout << "--pyramid must be between 0 and 16" << endl;
+            cout << desc << endl;
+            return 1;
+        }
+    }
+    if (vm.count("cache")) {
+        cacheFile = vm["cache"].as<std::string>();
+    }
+    if (vm.count("stats")) {
+        statsFile = vm["stats"].as<std::string>();
+    }
+    if (vm.count("points")) {
+        return queryPoints(objFile, cacheFile, maxObjects, vm["points"].as<std::string>(), outFile, nThreads);
+    }
     
     Vector3 start = sceneBBox.start;
     Vector3 stop  = sceneBBox.stop;
@@ -104,143 +468,412 @@ int main(int argc, char **argv) {
     if(maxObjects > 0) {
     cout << "reading in only     " << maxObjects << " objects" << endl;
     }
-    cout << endl;
+    cout << "threads:            " << nThreads << endl;
+    if(engine == Voxelizer::Rasterization) {
+    cout << "rasterizing triangles instead of tracing rays" << endl;
+    }
+    if(usePackets) {
+    cout << "tracing 4-ray packets" << endl;
+    }
+    if(useSceneBVH) {
+    cout << "tracing through a scene-wide BVH" << endl;
+    }
+    if(triangleLayout != TriangleStore::Expanded) {
+    cout << "triangle layout:    " << (triangleLayout == TriangleStore::Quantized ? "quantized" : "compact") << endl;
+    }
+    if(slabThickness > 0) {
+    cout << "slab thickness:     " << slabThickness << endl;
+    }
+    if(nScales > 0) {
+    cout << "pyramid scales:     " << nScales << endl;
+    }
+    
+    // With --incremental, the previous output can be updated if its
+    // manifest was written with the same settings.
+    const std::string manifestFile = outFile + ".manifest";
+    OutputManifest manifest, previousManifest;
+    bool havePrevious = false;
+    if(incremental) {
+        std::stringstream settings;
+        settings << std::setprecision(9) << "scene " << start << stop
+                 << " shape " << shape[0] << "," << shape[1] << "," << shape[2]
+                 << " chunk " << chunkShape[0] << "," << chunkShape[1] << "," << chunkShape[2]
+                 << " codec " << codec << " level " << compressionLevel << " format " << format
+                 << " pyramid " << nScales
+                 << (triangleLayout == TriangleStore::Quantized ? " quantize" : "");
+        manifest.settings = settings.str();
+        havePrevious = previousManifest.read(manifestFile) && previousManifest.settings == manifest.settings
+                       && ::access(outFile.c_str(), F_OK) == 0;
+        if(havePrevious) {
+            cout << "updating the output of the previous run (" << previousManifest.objects.size() << " objects)" << endl;
+        }
+        else {
+            cout << "no previous run with the same settings, voxelizing everything" << endl;
+        }
+    }
    
     //swap, vigra order has z,y,x
     shape = vigra::Shape3(shape[2], shape[1], shape[0]);
+    chunkShape = vigra::Shape3(chunkShape[2], chunkShape[1], chunkShape[0]);
+    
+    if(!pyramidFits(shape, chunkShape, nScales)) {
+        cout << "With --pyramid " << nScales << ", the chunk shape must be a multiple of " << (1 << nScales)
+             << " along every axis (or cover the whole volume)" << endl;
+        return 1;
+    }
+    
+    // With --roi or --tile, only the block [roiBegin, roiEnd) is
+    // voxelized and written into the output, which is created by the
+    // first such run and updated by the others. The block has to consist
+    // of whole chunks, so that runs for disjoint blocks never write to
+    // the same chunk.
+    const vigra::Shape3 chunks = ChunkedVolumeWriter::clipChunkShape(shape, chunkShape);
+    
+    vigra::Shape3 roiBegin(0, 0, 0);
+    vigra::Shape3 roiEnd = shape;
+    if(useROI) {
+        roiBegin = vigra::Shape3(roi.start[2], roi.start[1], roi.start[0]);
+        roiEnd = vigra::Shape3(roi.stop[2], roi.stop[1], roi.stop[0]);
+    }
+    if(useTile) {
+        // split the chunk planes along the last (vigra) axis evenly
+        const vigra::MultiArrayIndex nChunkPlanes = (shape[2] + chunks[2] - 1) / chunks[2];
+        roiBegin[2] = std::min(tile.index * nChunkPlanes / tile.count * chunks[2], shape[2]);
+        roiEnd[2] = std::min((tile.index + 1) * nChunkPlanes / tile.count * chunks[2], shape[2]);
+        if(roiBegin[2] == roiEnd[2]) {
+            cout << "tile " << tile.index << "/" << tile.count << " is empty, the volume only has "
+                 << nChunkPlanes << " planes of chunks" << endl;
+            return 0;
+        }
+    }
+    if(useROI || useTile) {
+        for(int i=0; i<3; ++i) {
+            if(roiBegin[i] >= roiEnd[i] || roiEnd[i] > shape[i] || roiBegin[i] % chunks[i] != 0
+               || (roiEnd[i] % chunks[i] != 0 && roiEnd[i] != shape[i]))
+            {
+                cout << "The region of interest must lie inside of the volume and consist of whole chunks ("
+                     << chunks[2] << ", " << chunks[1] << ", " << chunks[0] << ")" << endl;
+                return 1;
+            }
+        }
+        cout << "region of interest: (" << roiBegin[2] << ", " << roiBegin[1] << ", " << roiBegin[0] << ")("
+             << roiEnd[2] << ", " << roiEnd[1] << ", " << roiEnd[0] << ")" << endl;
+    }
+    cout << endl;
+    
+    ProgressReporter progress(cout);
     
     Scene scn;
     OBJReader r(objFile);
     if(maxObjects > 0) {
         r.setMaxObjects(maxObjects);
     }
+    r.setNumThreads(nThreads);
+    if((useROI || useTile) && cacheFile.empty()) {
+        // objects which cannot reach the region are not kept (a cache
+        // always holds the whole scene)
+        r.setBounds(Voxelizer::regionBounds(start, stop, shape, roiBegin, roiEnd));
+    }
     
     // Allows to set a maximum allowed edge length for triangles considered.
     // Disabled for now.
     const float edgeLengthThreshold = -1.0; 
     
-    cout << "*** reading all objects" << endl;
-    r.read(scn);
-    cout << endl;
-   
-    cout << "*** building BVHs" << endl;
-    for(auto& m : scn.meshes) {
-        m.buildBVH(edgeLengthThreshold);
+    // Quantized vertices lie on a grid of 65536 points per axis over the
+    // scene, so every object within it fits into 16 bit coordinates.
+    VertexGrid vertexGrid;
+    vertexGrid.start = start;
+    vertexGrid.step = (1.0f / 65535.0f) * (stop - start);
+    
+    std::unique_ptr<SceneCache> cache;
+    if(!cacheFile.empty()) {
+        cache.reset(new SceneCache(cacheFile, objFile, maxObjects, edgeLengthThreshold, triangleLayout, vertexGrid));
     }
-    cout << endl;
     
-    auto to_voxel_coor = [shape, start, stop](const Vector3& p) -> std::array<long int, 3> {
-        std::array<long int, 3> out;
-        for(int i=0; i<3; ++i) {
-            out[i] = std::round( (p[i]-start[i])/((float)(stop[i]-start[i]))*shape[i] );
+    // The blocks to voxelize: the region of interest or, when updating
+    // the output of a previous --incremental run, the regions affected by
+    // the objects which changed since.
+    std::vector<OutputManifest::Region> regions(1, std::make_pair(roiBegin, roiEnd));
+    auto planRegions = [&]() {
+        if(!incremental) {
+            return;
         }
-        return out;
-    };
-    auto to_scene_coor = [shape, start, stop](float x, float y, float z) -> Vector3 {
-        Vector3 out(x,y,z);
-        for(int i=0; i<3; ++i) {
-            out[i] = out[i]/((float)shape[i]) * (stop[i]-start[i]) + start[i];
+        manifest.objects.resize(scn.meshes.size());
+        for(size_t i=0; i<scn.meshes.size(); ++i) {
+            OutputManifest::Object& o = manifest.objects[i];
+            o.hash = OutputManifest::hashMesh(scn.meshes[i]);
+            if(scn.meshes[i].vertices.empty()
+               || !Voxelizer::affectedRegion(scn.meshes[i].bbox(), start, stop, shape, o.begin, o.end))
+            {
+                o.begin = o.end = vigra::Shape3(0, 0, 0);
+            }
+        }
+        if(havePrevious && labelTypeFor(previousManifest.objects.size()) != labelTypeFor(scn.meshes.size())) {
+            // the existing output cannot hold the labels
+            cout << "*** the label type changed from " << labelTypeName(labelTypeFor(previousManifest.objects.size()))
+                 << " to " << labelTypeName(labelTypeFor(scn.meshes.size())) << ", voxelizing everything" << endl;
+            cout << endl;
+            havePrevious = false;
+        }
+        if(!havePrevious) {
+            return;
+        }
+        regions = manifest.changedRegions(previousManifest, shape, chunks);
+        cout << "*** " << regions.size() << " changed regions" << endl;
+        for(const OutputManifest::Region& region : regions) {
+            cout << "  (" << region.first[2] << ", " << region.first[1] << ", " << region.first[0] << ")("
+                 << region.second[2] << ", " << region.second[1] << ", " << region.second[0] << ")" << endl;
         }
-        return out;
+        cout << endl;
     };
-
-    typedef vigra::MultiArray<3, uint16_t> V;
-    V vol[3] = {V(shape), V(shape), V(shape)};
-   
-    for(int rayAxis = 0; rayAxis<3; ++rayAxis) {
-        int otherAxes[2];
-        {
-            int j = 0;
-            for(int i=0; i<3; ++i) { 
-                if(i!=rayAxis) {
-                    otherAxes[j] = i;
-                    ++j;
+    
+    progress.beginPhase("parse", 0, "objects");
+    if(cache && cache->read(scn)) {
+        progress.add(scn.meshes.size());
+        progress.endPhase();
+        cout << "*** read " << scn.meshes.size() << " objects from cache " << cacheFile << endl;
+        cout << endl;
+        planRegions();
+    }
+    else {
+        cout << "*** reading all objects" << endl;
+        r.read(scn);
+        progress.add(scn.meshes.size());
+        progress.endPhase();
+        cout << endl;
+        planRegions();
+        
+        if(havePrevious && !cache) {
+            // objects which cannot reach any changed region are not needed
+            for(size_t i=0; i<scn.meshes.size(); ++i) {
+                const OutputManifest::Object& o = manifest.objects[i];
+                bool needed = false;
+                for(const OutputManifest::Region& region : regions) {
+                    bool overlaps = true;
+                    for(int k=0; k<3; ++k) {
+                        overlaps = overlaps && o.begin[k] < region.second[k] && region.first[k] < o.end[k];
+                    }
+                    needed = needed || overlaps;
+                }
+                if(!needed) {
+                    std::vector<Vector3>().swap(scn.meshes[i].vertices);
+                    std::vector<Mesh::Tri>().swap(scn.meshes[i].faces);
                 }
             }
         }
-        
-        cout << "*** tracing objects (ray axis = " << rayAxis << ")" << endl;
-        for(uint32_t currentLabel = 0; currentLabel < scn.meshes.size(); ++currentLabel) {
-            const Mesh& m = scn.meshes[currentLabel];
-            if(!m.bvh()) {
-                continue;
+       
+        // the rasterizer needs no BVHs, but the cache and the compact
+        // triangle layouts are built with them
+        if(engine == Voxelizer::RayTracing || cache || triangleLayout != TriangleStore::Expanded) {
+            cout << "*** building BVHs" << endl;
+            // Large meshes are built one after the other, each using all
+            // threads; all other meshes are built concurrently, one per thread.
+            const size_t largeMeshFaces = 1 << 16;
+            std::vector<size_t> largeMeshes, smallMeshes;
+            for(size_t i=0; i<scn.meshes.size(); ++i) {
+                (scn.meshes[i].faces.size() >= largeMeshFaces ? largeMeshes : smallMeshes).push_back(i);
             }
-            
-            const BVH& bvh = *m.bvh();
-            cout << "  tracing " << currentLabel << "/" << scn.meshes.size()
-                    << " '" << scn.meshes[currentLabel].name() << "'"
-                    << endl;
-        
-            size_t nRaysTotal = shape[0]*shape[1];
-            size_t nRays = 0;
-            const int N = 1;
+            std::vector<double> buildTime(scn.meshes.size());
+            auto buildBVH = [&](size_t i, int threads) {
+                auto t0 = std::chrono::steady_clock::now();
+                if(triangleLayout == TriangleStore::Expanded) {
+                    scn.meshes[i].buildBVH(edgeLengthThreshold, threads);
+                }
+                else {
+                    scn.meshes[i].buildCompactBVH(edgeLengthThreshold,
+                                                  triangleLayout == TriangleStore::Quantized ? &vertexGrid : 0,
+                                                  threads);
+                }
+                buildTime[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                progress.add(1);
+            };
+            progress.beginPhase("build BVH", scn.meshes.size(), "objects");
+            for(size_t i : largeMeshes) {
+                buildBVH(i, nThreads);
+            }
+            parallelFor(smallMeshes.size(), nThreads, [&](size_t k, int) {
+                buildBVH(smallMeshes[k], 1);
+            });
+            progress.endPhase();
         
-            
-            vigra::TinyVector<vigra::MultiArrayIndex, 3> coord;
-            for(coord[otherAxes[0]] = 0; coord[otherAxes[0]] < shape[otherAxes[0]];
-                ++coord[otherAxes[0]]) {
-            for(coord[otherAxes[1]] = 0; coord[otherAxes[1]] < shape[otherAxes[1]];
-                ++coord[otherAxes[1]]) {
-                cout << "  " << nRays << "/" << nRaysTotal << "                   \r" << std::flush;
-                ++nRays;
-            
-                float c[3] = {coord[0]+0.5f, coord[1]+0.5f, coord[2]+0.5f};
-                c[rayAxis] = -10.0f;
-                
-                const Vector3 normal(1 ? rayAxis==0 : 0,
-                                     1 ? rayAxis==1 : 0,
-                                     1 ? rayAxis==2 : 0);
-                
-                Vector3 rayStart = to_scene_coor(c[0], c[1], c[2]);
-                Ray ray(rayStart, normal);
-                IntersectionInfo I;
-                bool hit = bvh.getIntersection(ray, &I, false);
-                bool inside = false;
-                
-                std::array<long int, 3> prevVoxelCoor = {coord[0], coord[1], coord[2]};
-                prevVoxelCoor[rayAxis] = -10.0f;
-                
-                while(hit) {
-                    std::array<long int, 3> currVoxelCoor = to_voxel_coor(I.hit);
-                    if(inside) {
-                        vigra::MultiArrayIndex& t = coord[rayAxis];
-                        for(t=prevVoxelCoor[rayAxis]+1;
-                            t<=currVoxelCoor[rayAxis]; ++t)
-                        {
-                            if(t >= 0 && t < shape[2-rayAxis]) {
-                                vol[rayAxis](coord[2], coord[1], coord[0]) = currentLabel + 1;
-                            }
-                        }
+            for(size_t i=0; i<scn.meshes.size(); ++i) {
+                const Mesh& m = scn.meshes[i];
+                cout << "  " << m.label() << " '" << m.name() << "': ";
+                if(m.bvh()) {
+                    const TriangleStore& tris = m.bvh()->triangles();
+                    cout << tris.size() << " / " << m.faces.size() << " tris, "
+                         << m.bvh()->nodes().size() << " nodes, "
+                         << m.bvh()->nLeaves() << " leaves, ";
+                    if(tris.layout() != TriangleStore::Expanded) {
+                        cout << tris.memoryUsage() / 1024.0 << " KB ("
+                             << 100.0 * (1.0 - double(tris.memoryUsage()) / tris.expandedMemoryUsage())
+                             << "% less), ";
                     }
-                    prevVoxelCoor = currVoxelCoor;
-                    rayStart = I.hit + 10*std::numeric_limits<float>::epsilon() * ray.d;
-                    inside = !inside;
-                    ray = Ray(rayStart, normal);
-                    hit = bvh.getIntersection(ray, &I, false);
                 }
+                else {
+                    cout << "no triangles, ";
+                }
+                cout << 1000*buildTime[i] << " ms" << endl;
             }
-            }
-        } /* iteration over all objects in the scene */
-        cout << "  ... done tracing" << endl << endl;
-    } /* ray axis iteration */
-   
-    cout << "majority vote ... " << std::flush;
-    for(int i=0; i<vol[0].size(); ++i) {
-        const uint16_t a = vol[0][i];
-        const uint16_t b = vol[1][i];
-        const uint16_t c = vol[2][i];
-        if     ( a == b ) { vol[0][i] = a; }
-        else if( a == c ) { vol[0][i] = a; }
-        else if( b == c ) { vol[0][i] = b; }
-        else              { vol[0][i] = 0; }
-    }
-    cout << " done" << endl;
-    
-    cout << "writing file ... " << std::flush;
-    vigra::HDF5File file(outFile, vigra::HDF5File::New);
-    file.write("labels", vol[0], 64, 1); 
-    file.close();
-    cout << " done" << endl;
+            cout << endl;
+        }
+        
+        if(cache) {
+            cout << "*** writing cache " << cacheFile << endl;
+            progress.beginPhase("write cache", 1, "files");
+            cache->write(scn);
+            progress.add(1);
+            progress.endPhase();
+            cout << endl;
+        }
+    }
+    
+    size_t triangleBytes = 0, expandedTriangleBytes = 0;
+    for(Mesh& m : scn.meshes) {
+        if(!m.bvh()) {
+            continue;
+        }
+        triangleBytes += m.bvh()->triangles().memoryUsage();
+        expandedTriangleBytes += m.bvh()->triangles().expandedMemoryUsage();
+        if(triangleLayout != TriangleStore::Expanded) {
+            // only the compact triangles are traced (or rasterized)
+            std::vector<Vector3>().swap(m.vertices);
+            std::vector<Mesh::Tri>().swap(m.faces);
+        }
+    }
+    if(triangleLayout != TriangleStore::Expanded && expandedTriangleBytes > 0) {
+        cout << "*** triangles take " << triangleBytes / 1e6 << " MB instead of " << expandedTriangleBytes / 1e6
+             << " MB (" << 100.0 * (1.0 - double(triangleBytes) / expandedTriangleBytes) << "% less)" << endl;
+        cout << endl;
+    }
+    
+    // The labels are stored in the narrowest type which holds them all,
+    // so the writers are created once the number of objects is known.
+    const LabelType labelType = labelTypeFor(scn.meshes.size());
+    cout << "*** labels of " << scn.meshes.size() << " objects stored as " << labelTypeName(labelType) << endl;
+    cout << endl;
+    const bool update = useROI || useTile || havePrevious;
+    std::unique_ptr<ChunkedVolumeWriter> writer;
+    if(format == "zarr") {
+        writer.reset(new ZarrWriter(outFile, "labels", shape, chunks, labelType, codec, compressionLevel, nThreads,
+                                    update));
+    }
+    else {
+        writer.reset(new HDF5ChunkWriter(outFile, "labels", shape, chunks, labelType, codec, compressionLevel,
+                                         nThreads, update));
+    }
+    
+    // Scale s of the pyramid has chunks of chunks / 2^s, so that every
+    // block of whole chunks maps to whole chunks on all scales and can be
+    // downsampled on its own, right after voting.
+    std::vector<std::unique_ptr<ChunkedVolumeWriter> > scaleWriters;
+    for(int scale=1; scale<=nScales; ++scale) {
+        const std::string dataset = "labels_s" + std::to_string(scale);
+        const vigra::Shape3 scaleShape = pyramidShape(shape, scale);
+        const vigra::Shape3 scaleChunks = pyramidShape(chunks, scale);
+        if(format == "zarr") {
+            scaleWriters.emplace_back(new ZarrWriter(outFile, dataset, scaleShape, scaleChunks, labelType, codec,
+                                                     compressionLevel, nThreads, update));
+        }
+        else {
+            // the file was just created (or opened) by writer
+            scaleWriters.emplace_back(new HDF5ChunkWriter(outFile, dataset, scaleShape, scaleChunks, labelType, codec,
+                                                          compressionLevel, nThreads, true));
+        }
+    }
+    
+    Voxelizer voxelizer(scn, start, stop, shape);
+    voxelizer.setNumThreads(nThreads);
+    voxelizer.setEngine(engine);
+    voxelizer.setPackets(usePackets);
+    voxelizer.setSceneBVH(useSceneBVH);
+    voxelizer.setProgress(&progress);
+    voxelizer.setLog(&cout);
+    
+    switch(labelType) {
+        case Label8:
+            voxelizeRegions<uint8_t>(voxelizer, regions, shape, chunks, slabThickness, *writer, scaleWriters,
+                                     nThreads, progress);
+            break;
+        case Label16:
+            voxelizeRegions<uint16_t>(voxelizer, regions, shape, chunks, slabThickness, *writer, scaleWriters,
+                                      nThreads, progress);
+            break;
+        case Label32:
+            voxelizeRegions<uint32_t>(voxelizer, regions, shape, chunks, slabThickness, *writer, scaleWriters,
+                                      nThreads, progress);
+            break;
+    }
+    writer->close();
+    for(auto& w : scaleWriters) {
+        w->close();
+    }
+    
+    if(regions.empty()) {
+        cout << "nothing changed since the previous run" << endl;
+    }
+    else {
+        cout << "wrote " << writer->rawBytes() / 1e6 << " MB (" << writer->storedBytes() / 1e6 << " MB stored, "
+             << writer->nChunksStored() << " chunks, " << writer->nChunksSkipped() << " empty chunks skipped) in "
+             << writer->seconds() << " s";
+        if(writer->seconds() > 0) {
+            cout << ", " << writer->rawBytes() / 1e6 / writer->seconds() << " MB/s";
+        }
+        cout << endl;
+        for(int scale=1; scale<=nScales; ++scale) {
+            const ChunkedVolumeWriter& w = *scaleWriters[scale-1];
+            cout << "  scale " << scale << ": " << w.rawBytes() / 1e6 << " MB (" << w.storedBytes() / 1e6
+                 << " MB stored, " << w.nChunksStored() << " chunks)" << endl;
+        }
+    }
+    cout << endl;
+    
+    if(incremental) {
+        // written last: after an interrupted run, the previous manifest
+        // is still in place and the next run redoes the same regions
+        manifest.write(manifestFile);
+    }
+    
+    cout << "*** summary" << endl;
+    progress.summary(cout);
+    printTraversalCost(scn);
+    
+    if(!statsFile.empty()) {
+        std::stringstream shapeJSON, outputJSON;
+        shapeJSON << "[" << shape[2] << ", " << shape[1] << ", " << shape[0] << "]";
+        outputJSON << "{\"file\": " << jsonString(outFile) << ", \"format\": " << jsonString(format)
+                   << ", \"raw_bytes\": " << writer->rawBytes() << ", \"stored_bytes\": " << writer->storedBytes()
+                   << ", \"chunks_stored\": " << writer->nChunksStored()
+                   << ", \"chunks_skipped\": " << writer->nChunksSkipped()
+                   << ", \"label_type\": " << jsonString(labelTypeName(labelType))
+                   << ", \"pyramid_scales\": " << nScales << "}";
+        std::stringstream trianglesJSON;
+        trianglesJSON << "{\"layout\": "
+                      << jsonString(triangleLayout == TriangleStore::Quantized ? "quantized"
+                                    : triangleLayout == TriangleStore::Indexed ? "compact" : "expanded")
+                      << ", \"bytes\": " << triangleBytes << ", \"expanded_bytes\": " << expandedTriangleBytes
+                      << ", \"trace_seconds\": " << progress.seconds("trace axis ") + progress.seconds("fill axis ")
+                      << "}";
+        std::vector<std::pair<std::string, std::string> > members;
+        members.push_back(std::make_pair("input", jsonString(objFile)));
+        members.push_back(std::make_pair("objects", std::to_string(scn.meshes.size())));
+        members.push_back(std::make_pair("shape", shapeJSON.str()));
+        if(useROI || useTile) {
+            std::stringstream roiJSON;
+            roiJSON << "[[" << roiBegin[2] << ", " << roiBegin[1] << ", " << roiBegin[0] << "], ["
+                    << roiEnd[2] << ", " << roiEnd[1] << ", " << roiEnd[0] << "]]";
+            members.push_back(std::make_pair("roi", roiJSON.str()));
+        }
+        members.push_back(std::make_pair("threads", std::to_string(nThreads)));
+        members.push_back(std::make_pair("triangles", trianglesJSON.str()));
+        members.push_back(std::make_pair("output", outputJSON.str()));
+        std::ofstream stats(statsFile.c_str());
+        progress.writeJSON(stats, members);
+        if(!stats) {
+            cout << "could not write " << statsFile << endl;
+            return 1;
+        }
+    }
 
     return 0;
 }
\ No newline at end of file